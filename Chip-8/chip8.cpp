@@ -5,8 +5,13 @@
  */
 
 #include "chip8.h"
+#include "chip8Jit.h"
+#include "chip8Audio.h"
 
-unsigned char chip8_fontset[80] =
+#define IDLE_MIN   64       // Smallest Run() budget worth a wait loop check
+#define IDLE_SLICE 1024     // Instructions to the first check after a miss, doubles
+
+static const unsigned char chip8_fontset[80] =
 { 
     0xF0, 0x90, 0x90, 0x90, 0xF0, //0
     0x20, 0x60, 0x20, 0x20, 0x70, //1
@@ -26,6 +31,27 @@ unsigned char chip8_fontset[80] =
     0xF0, 0x80, 0xF0, 0x80, 0x80  //F
 };
 
+// SUPER-CHIP 8x10 digits (A-F as in XO-CHIP), loaded at CHIP8_BIGFONT
+static const unsigned char chip8_bigfontset[160] =
+{
+    0x3C, 0x7E, 0xE7, 0xC3, 0xC3, 0xC3, 0xC3, 0xE7, 0x7E, 0x3C, //0
+    0x18, 0x38, 0x58, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x3C, //1
+    0x3E, 0x7F, 0xC3, 0x06, 0x0C, 0x18, 0x30, 0x60, 0xFF, 0xFF, //2
+    0x3C, 0x7E, 0xC3, 0x03, 0x0E, 0x0E, 0x03, 0xC3, 0x7E, 0x3C, //3
+    0x06, 0x0E, 0x1E, 0x36, 0x66, 0xC6, 0xFF, 0xFF, 0x06, 0x06, //4
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFC, 0xFE, 0x03, 0xC3, 0x7E, 0x3C, //5
+    0x3E, 0x7C, 0xE0, 0xC0, 0xFC, 0xFE, 0xC3, 0xC3, 0x7E, 0x3C, //6
+    0xFF, 0xFF, 0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0x60, 0x60, //7
+    0x3C, 0x7E, 0xC3, 0xC3, 0x7E, 0x7E, 0xC3, 0xC3, 0x7E, 0x3C, //8
+    0x3C, 0x7E, 0xC3, 0xC3, 0x7F, 0x3F, 0x03, 0x03, 0x3E, 0x7C, //9
+    0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, //A
+    0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, //B
+    0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, //C
+    0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, //D
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, //E
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  //F
+};
+
 void Chip8::Initialize() {
     
     pc  = 0x200;        // PC starts at 0x200
@@ -33,15 +59,18 @@ void Chip8::Initialize() {
     I   = 0;            // Reset index register
     opcode  = 0;        // Reset current opcode
     
-    // Clear display
+    // Clear display, back to lo-res on plane 0
     memset(gfx, 0x00, sizeof(gfx));
     drawFlag = true;
+    hires    = false;
+    planes   = 0x1;
     
     // Clear stack
     memset(stack, 0x00, sizeof(stack));   
     
     // Clear registers
     memset(V, 0x00, sizeof(V));
+    memset(flags, 0x00, sizeof(flags));
     
     // Clear memory
     memset(memory, 0x00, sizeof(memory)); 
@@ -53,20 +82,32 @@ void Chip8::Initialize() {
     for(unsigned int i=0; i<80; ++i) {
         memory[i] = chip8_fontset[i];
     }
+    if (Chip8GetQuirkFlags(quirks).isa != CHIP8_ISA_CHIP8) {
+        memcpy(memory + CHIP8_BIGFONT, chip8_bigfontset, sizeof(chip8_bigfontset));
+    }
 
-    // Reset timers
+    // Reset timers and XO-CHIP audio
     timer_delay = 0;
     timer_sound = 0;
+    memset(pattern, 0x00, sizeof(pattern));
+    pitch = 64;             // 4000 Hz
     
-    // Seed rand
-    srand (time(NULL));
+    // Drop decoded / compiled code
+    if (!decoded.empty()) {
+        memset(&decoded[0], 0x00, decoded.size() * sizeof(Chip8Instr));
+    }
+    if (jit) {
+        jit->Flush();
+    }
+    
+    // Restart the random sequence, count cycles from the load
+    Seed(rngSeed);
+    cycleCount = 0;
+    idleWait = false;
 }
 
 bool Chip8::LoadApplication(const char * filename)
 {
-    // Initialize the processor
-    Initialize();
-        
     // Open file
     printf("Loading: %s\n", filename);
     FILE * pFile = fopen(filename, "rb");
@@ -82,9 +123,10 @@ bool Chip8::LoadApplication(const char * filename)
     printf("Filesize: %d\n", (int)lSize);
 	
 	// Allocate memory to contain the whole file
-	char * buffer = (char*)malloc(sizeof(char) * lSize);
+	unsigned char * buffer = (unsigned char*)malloc(sizeof(char) * lSize);
 	if (buffer == NULL) {
         fputs ("Memory error", stderr); 
+        fclose(pFile);
         return false;
     }
 
@@ -92,15 +134,14 @@ bool Chip8::LoadApplication(const char * filename)
     size_t result = fread (buffer, 1, lSize, pFile);
     if (result != (size_t)lSize) {
         fputs("Reading error",stderr); 
+        fclose(pFile);
+        free(buffer);
         return false;
     }
 
     // Copy buffer to Chip8 memory
-    if((4096-512) > lSize) {
-        for(int i = 0; i < lSize; ++i) {
-            memory[i + 512] = buffer[i];
-        }
-    } else {
+    bool loaded = LoadApplication(buffer, lSize);
+    if (!loaded) {
         printf("Error: ROM too big for memory");
     }
 	
@@ -108,25 +149,60 @@ bool Chip8::LoadApplication(const char * filename)
     fclose(pFile);
     free(buffer);
 
+    return loaded;
+}
+
+bool Chip8::LoadApplication(const unsigned char * data, long size)
+{
+    // Initialize the processor
+    Initialize();
+
+    // XO-CHIP images may fill the whole 64 KB
+    long limit = (Chip8GetQuirkFlags(quirks).isa == CHIP8_ISA_XO) ? CHIP8_MEMORY : 4096;
+    if (size < 0 || size > (limit - 512)) {
+        return false;
+    }
+
+    memcpy(memory + 512, data, size);
     return true;
 }
 
-void Chip8::EmulateCycle() {
+// Reference interpreter, one instruction
+template <class Q>
+void Chip8::Step() {
     
     // Fetch Opcode
-    opcode = (memory[pc] << 8) | (memory[pc + 1]);
+    opcode = (memory[pc & 0x0FFF] << 8) | (memory[(pc + 1) & 0x0FFF]);
+    CHIP8_PROFILE_HOOK(profile->Instruction(pc, opcode, Q::isa));
     
     // Decode / Execute Opcode
     switch (opcode & 0xF000) {
         case 0x0000: {
+            if (Q::isa != CHIP8_ISA_CHIP8 && (opcode & 0xFFF0) == 0x00C0 && (opcode & 0x000F) != 0) {
+                ScrollDown(opcode & 0x000F);    // 00CN  Scrolls the display down by N lines.
+                break;
+            }
+            if (Q::isa == CHIP8_ISA_XO && (opcode & 0xFFF0) == 0x00D0) {
+                ScrollUp(opcode & 0x000F);      // 00DN  Scrolls the display up by N lines.
+                break;
+            }
+            if (Q::isa != CHIP8_ISA_CHIP8 && opcode >= 0x00FB && opcode <= 0x00FF) {
+                switch (opcode) {
+                    case 0x00FB: ScrollRight();   break;    // 00FB  Scrolls the display right by 4 pixels.
+                    case 0x00FC: ScrollLeft();    break;    // 00FC  Scrolls the display left by 4 pixels.
+                    case 0x00FD: return;                    // 00FD  Exits the interpreter: stays here.
+                    case 0x00FE: SetHires(false); break;    // 00FE  Lo-res (64x32).
+                    case 0x00FF: SetHires(true);  break;    // 00FF  Hi-res (128x64).
+                }
+                break;
+            }
             switch(opcode & 0x000F) {   
                 case 0x0000: { // 00E0  Clears the screen.                    
-                    memset(gfx, 0x00, sizeof(gfx));
-                    drawFlag = true;
+                    ClearScreen();
                     break;
                 }
                 case 0x000E: { // 00EE  Returns from a subroutine.
-                    sp--;
+                    sp = (sp - 1) & 0x0F;
                     pc = stack[sp];
                     stack[sp] = 0x00;
                     break;
@@ -145,26 +221,44 @@ void Chip8::EmulateCycle() {
         }
         case 0x2000: { // 2NNN  Calls subroutine at NNN.
             stack[sp] = pc;
-            sp++;
+            sp = (sp + 1) & 0x0F;
             pc = opcode & 0x0FFF;
             pc -= OPCODE_LEN;       // Prevent PC from incrimenting
             break;
         }
         case 0x3000: { // 3XNN  Skips the next instruction if VX equals NN.
             if ( V[(opcode & 0x0F00) >> 8] == (opcode & 0x00FF) ) {
-                pc += 2;
+                pc += SkipLength<Q>(pc);
             } 
             break;
         }
         case 0x4000: { // 4XNN	    Skips the next instruction if VX doesn't equal NN.
             if ( V[(opcode & 0x0F00) >> 8] != (opcode & 0x00FF) ) {
-                pc += 2;
+                pc += SkipLength<Q>(pc);
             }
             break;
         }
-        case 0x5000: {  // 5XY0	    Skips the next instruction if VX equals VY.
-            if ( V[(opcode & 0x0F00) >> 8] == V[opcode & 0x00F0 >> 4] ) {
-                pc += 2;
+        case 0x5000: {
+            int x = (opcode & 0x0F00) >> 8;
+            int y = (opcode & 0x00F0) >> 4;
+            if (Q::isa == CHIP8_ISA_XO && (opcode & 0x000E) == 0x0002) {
+                // 5XY2 / 5XY3  Stores / loads VX to VY (either order) at I, I unchanged.
+                int step = (x <= y) ? 1 : -1;
+                for (int i = 0, r = x; ; ++i, r += step) {
+                    if (opcode & 0x0001) {
+                        V[r] = memory[(I + i) & Chip8AddrMask<Q>()];
+                    } else {
+                        StoreByte((I + i) & Chip8AddrMask<Q>(), V[r]);
+                    }
+                    if (r == y) {
+                        break;
+                    }
+                }
+                break;
+            }
+            // 5XY0	    Skips the next instruction if VX equals VY.
+            if ( V[x] == V[y] ) {
+                pc += SkipLength<Q>(pc);
             } 
             break;
         }
@@ -184,14 +278,23 @@ void Chip8::EmulateCycle() {
                 }
                 case 0x0001: { // 8XY1	    Sets VX to VX or VY.
                     V[(opcode & 0x0F00) >> 8] |= V[(opcode & 0x00F0) >> 4];
+                    if (Q::logicVf) {
+                        V[0xF] = 0;
+                    }
                     break;
                 }
                 case 0x0002: { // 8XY2	    Sets VX to VX and VY.
                     V[(opcode & 0x0F00) >> 8] &= V[(opcode & 0x00F0) >> 4];
+                    if (Q::logicVf) {
+                        V[0xF] = 0;
+                    }
                     break;
                 }
                 case 0x0003: { // 8XY3	    Sets VX to VX xor VY.
                     V[(opcode & 0x0F00) >> 8] ^= V[(opcode & 0x00F0) >> 4];
+                    if (Q::logicVf) {
+                        V[0xF] = 0;
+                    }
                     break;
                 }
                 case 0x0004: { // 8XY4	    Adds VY to VX. VF is set to 1 when there's a carry, and to 0 when there isn't.
@@ -213,6 +316,9 @@ void Chip8::EmulateCycle() {
                     break;
                 }
                 case 0x0006: { // 8XY6	    Shifts VX right by one. VF is set to the value of the least significant bit of VX before the shift.[2]
+                    if (Q::shiftVy) {
+                        V[(opcode & 0x0F00) >> 8] = V[(opcode & 0x00F0) >> 4];
+                    }
                     V[0xF] = V[(opcode & 0x0F00) >> 8] & 0x01;
                     V[(opcode & 0x0F00) >> 8] >>= 1;
                     break;
@@ -227,6 +333,9 @@ void Chip8::EmulateCycle() {
                     break;
                 }
                 case 0x000E: { // 8XYE	    Shifts VX left by one. VF is set to the value of the most significant bit of VX before the shift.[2]
+                    if (Q::shiftVy) {
+                        V[(opcode & 0x0F00) >> 8] = V[(opcode & 0x00F0) >> 4];
+                    }
                     V[0xF] = (V[(opcode & 0x0F00) >> 8] & 0x80) >> 7;
                     V[(opcode & 0x0F00) >> 8] <<= 1;
                     break;
@@ -239,8 +348,8 @@ void Chip8::EmulateCycle() {
             break;
         }
         case 0x9000: { // 9XY0	    Skips the next instruction if VX doesn't equal VY.
-            if ( V[(opcode & 0x0F00) >> 8] != V[opcode & 0x00F0 >> 4] ) {
-                pc += 2;
+            if ( V[(opcode & 0x0F00) >> 8] != V[(opcode & 0x00F0) >> 4] ) {
+                pc += SkipLength<Q>(pc);
             }
             break;
         }
@@ -249,47 +358,31 @@ void Chip8::EmulateCycle() {
             break;
         }
         case 0xB000: { // BNNN	    Jumps to the address NNN plus V0.
-            pc = (opcode & 0x0FFF) + V[0];
+            pc = (opcode & 0x0FFF) + V[Q::jumpVx ? (opcode & 0x0F00) >> 8 : 0];
             pc -= OPCODE_LEN;       // Prevent PC from incrimenting
             break;
         }
         case 0xC000: { // CXNN	    Sets VX to a random number and NN.
-			V[(opcode & 0x0F00) >> 8] = (rand() % 0xFF) & (opcode & 0x00FF);
-            pc -= OPCODE_LEN;       // Prevent PC from incrimenting
+			V[(opcode & 0x0F00) >> 8] = (Random() % 0xFF) & (opcode & 0x00FF);
             break;
         }
         case 0xD000: { // DXYN	    Draws a sprite at coordinate (VX, VY) that has a width of 8 pixels and a height of N pixels. Each row of 8 pixels is read as bit-coded (with the most significant bit of each byte displayed on the left) starting from memory location I; I value doesn't change after the execution of this instruction. As described above, VF is set to 1 if any screen pixels are flipped from set to unset when the sprite is drawn, and to 0 if that doesn't happen.
             unsigned short x = V[(opcode & 0x0F00) >> 8];
             unsigned short y = V[(opcode & 0x00F0) >> 4];
-            unsigned short height = opcode & 0x000F;
-            unsigned short pixel;
-         
-            V[0xF] = 0;
-            for (int yline = 0; yline < height; yline++) {
-                pixel = memory[I + yline];
-                for(int xline = 0; xline < 8; xline++) {
-                    if((pixel & (0x80 >> xline)) != 0) {
-                        if(gfx[(x + xline + ((y + yline) * 64))] == 1) {
-                            V[0xF] = 1;
-                        }
-                        gfx[x + xline + ((y + yline) * 64)] ^= 1;
-                    }
-                }
-            }         
-            drawFlag = true;
+            V[0xF] = Draw<Q>(x, y, opcode & 0x000F, I);   // DXY0: 16x16 under SUPER-CHIP
             break;
         }
         case 0xE000: { 
             switch (opcode & 0x00FF) {
                 case 0x009E: { // EX9E	Skips the next instruction if the key stored in VX is pressed.                          
-                    if(key[V[(opcode & 0x0F00) >> 8]] != 0) {
-                        pc += 2;
+                    if(key[V[(opcode & 0x0F00) >> 8] & 0x0F] != 0) {
+                        pc += SkipLength<Q>(pc);
                     } 
                     break;
                 }
                 case 0x00A1: { // EXA1	Skips the next instruction if the key stored in VX isn't pressed.               
-                    if(key[V[(opcode & 0x0F00) >> 8]] == 0) {
-                        pc += 2;
+                    if(key[V[(opcode & 0x0F00) >> 8] & 0x0F] == 0) {
+                        pc += SkipLength<Q>(pc);
                     } 
                     break;
                 }
@@ -301,6 +394,27 @@ void Chip8::EmulateCycle() {
             break;
         }
         case 0xF000: {
+            if (Q::isa == CHIP8_ISA_XO) {
+                if (opcode == 0xF000) {         // F000 NNNN  Sets I to the 16 bit address NNNN.
+                    I = (memory[(pc + 2) & 0x0FFF] << 8) | memory[(pc + 3) & 0x0FFF];
+                    pc += 2;
+                    break;
+                }
+                if (opcode == 0xF002) {         // F002  Loads the 16 byte audio pattern at I.
+                    for (int i = 0; i < 16; ++i) {
+                        pattern[i] = memory[(I + i) & 0xFFFF];
+                    }
+                    break;
+                }
+                if ((opcode & 0x00FF) == 0x0001) {  // FN01  Selects the bitplanes drawn to.
+                    planes = ((opcode & 0x0F00) >> 8) & 0x3;
+                    break;
+                }
+                if ((opcode & 0x00FF) == 0x003A) {  // FX3A  Sets the audio pitch to VX.
+                    pitch = V[(opcode & 0x0F00) >> 8];
+                    break;
+                }
+            }
             switch (opcode & 0x00FF) {
                 case 0x0007: { // FX07	Sets VX to the value of the delay timer.
                     V[(opcode & 0x0F00) >> 8] = timer_delay;
@@ -332,6 +446,10 @@ void Chip8::EmulateCycle() {
                     break;
                 }
                 case 0x001E: { // FX1E	Adds VX to I.
+                    if (Q::isa == CHIP8_ISA_XO) {
+                        I += V[(opcode & 0x0F00) >> 8];     // 16 bit I, VF untouched
+                        break;
+                    }
                     if (I + V[(opcode & 0x0F00) >> 8] > 0x0FFF) {
                         V[0xF] = 1;
                     } else {
@@ -345,26 +463,57 @@ void Chip8::EmulateCycle() {
                     break;
                 }
                 case 0x0033: { // FX33	Stores the Binary-coded decimal representation of VX, with the most significant of three digits at the address in I, the middle digit at I plus 1, and the least significant digit at I plus 2. (In other words, take the decimal representation of VX, place the hundreds digit in memory at location in I, the tens digit at location I+1, and the ones digit at location I+2.)
-                    memory[I]     =  V[(opcode & 0x0F00) >> 8] / 100;
-                    memory[I + 1] = (V[(opcode & 0x0F00) >> 8] / 10) % 10;
-                    memory[I + 2] = (V[(opcode & 0x0F00) >> 8] % 100) % 10;
+                    StoreByte( I      & Chip8AddrMask<Q>(),  V[(opcode & 0x0F00) >> 8] / 100);
+                    StoreByte((I + 1) & Chip8AddrMask<Q>(), (V[(opcode & 0x0F00) >> 8] / 10) % 10);
+                    StoreByte((I + 2) & Chip8AddrMask<Q>(), (V[(opcode & 0x0F00) >> 8] % 100) % 10);
+                    break;
+                }
+                case 0x0030: { // FX30	SUPER-CHIP: Sets I to the 8x10 digit for VX.
+                    if (Q::isa == CHIP8_ISA_CHIP8) {
+                        printf("Unknown opcode [0x0000]: 0x%X\n", opcode);
+                        break;
+                    }
+                    I = CHIP8_BIGFONT + (V[(opcode & 0x0F00) >> 8] & 0x0F) * 10;
+                    break;
+                }
+                case 0x0075:   // FX75	SUPER-CHIP: Stores V0 to VX in the RPL flags (X < 8, 16 under XO-CHIP).
+                case 0x0085: { // FX85	SUPER-CHIP: Fills V0 to VX from the RPL flags.
+                    if (Q::isa == CHIP8_ISA_CHIP8) {
+                        printf("Unknown opcode [0x0000]: 0x%X\n", opcode);
+                        break;
+                    }
+                    int last = (opcode & 0x0F00) >> 8;
+                    if (Q::isa == CHIP8_ISA_SCHIP) {
+                        last &= 0x7;
+                    }
+                    for (int i = 0; i <= last; ++i) {
+                        if ((opcode & 0x00FF) == 0x0075) {
+                            flags[i] = V[i];
+                        } else {
+                            V[i] = flags[i];
+                        }
+                    }
                     break;
                 }
                 case 0x0055: { // FX55	Stores V0 to VX in memory starting at address I.
                     for (int i = 0; i <= ((opcode & 0x0F00) >> 8); ++i)
-                        memory[I + i] = V[i];	
+                        StoreByte((I + i) & Chip8AddrMask<Q>(), V[i]);	
 
                     // On the original interpreter, when the operation is done, I = I + X + 1.
-                    I += ((opcode & 0x0F00) >> 8) + 1;
+                    if (Q::memIncI) {
+                        I += ((opcode & 0x0F00) >> 8) + 1;
+                    }
 
                     break;
                 }
                 case 0x0065: { // FX65	Fills V0 to VX with values from memory starting at address I.                    
                     for (int i = 0; i <= ((opcode & 0x0F00) >> 8); ++i)
-                        V[i] = memory[I + i];			
+                        V[i] = memory[(I + i) & Chip8AddrMask<Q>()];			
 
                     // On the original interpreter, when the operation is done, I = I + X + 1.
-                    I += ((opcode & 0x0F00) >> 8) + 1;
+                    if (Q::memIncI) {
+                        I += ((opcode & 0x0F00) >> 8) + 1;
+                    }
                    
                     break;
                 }
@@ -381,21 +530,189 @@ void Chip8::EmulateCycle() {
         }
     }
     
-    // Update pc
-    pc += OPCODE_LEN;
-        
-    // Update Timers
+    // Update pc (12 bit address space)
+    pc = (pc + OPCODE_LEN) & 0x0FFF;
+}
+
+template <class Q>
+void Chip8::RunInterpreter(unsigned long cycles) {
+    for (unsigned long i = 0; i < cycles; ++i) {
+        Step<Q>();
+    }
+}
+
+void Chip8::EmulateCycle() {
+    (this->*step)();
+}
+
+void Chip8::TickTimers() {
+    CHIP8_PROFILE_HOOK(profile->Frame(cycleCount));
+    
     if (timer_delay > 0) {
         timer_delay--;
     }
     
+    if (audio != NULL) {
+        audio->Tick(cycleCount, timer_sound > 0, pitch, pattern);
+    }
     if (timer_sound > 0) {
-        if(timer_sound == 1) {
-            printf("BEEP!\n");
-        }
         timer_sound--;
     }
 }
 
-void Chip8::SetKeys() {
+void Chip8::RunFrame(unsigned long cycles) {
+    Run(cycles);
+    TickTimers();
+}
+
+void Chip8::SetKeys(unsigned short mask) {
+    for (int i = 0; i < 16; ++i) {
+        key[i] = (mask >> i) & 1;
+    }
+}
+
+unsigned short Chip8::GetKeys() const {
+    unsigned short mask = 0;
+    for (int i = 0; i < 16; ++i) {
+        if (key[i] != 0) {
+            mask |= 1 << i;
+        }
+    }
+    return mask;
+}
+
+void Chip8::Seed(uint64_t seed) {
+    rngSeed = seed;
+    rng     = Chip8SeedRandom(seed);
+}
+
+Chip8::Chip8() : cycleCount(0), execMode(CHIP8_INTERPRETER), idleSkip(true), idleWait(false), audio(NULL) {
+    // Unseeded instances still get a different sequence per run
+    Seed((uint64_t)time(NULL) ^ (uint64_t)(uintptr_t)this);
+    SetQuirks(CHIP8_QUIRKS_CHIP8);
+#ifdef CHIP8_PROFILE
+    profile = NULL;
+#endif
+}
+
+Chip8::~Chip8() {
+}
+
+void Chip8::SetExecMode(Chip8ExecMode mode) {
+    if (mode == CHIP8_JIT) {
+        if (!jit) {
+            jit.reset(new Chip8Jit());
+        }
+        if (!jit->Ok()) {
+            jit.reset();
+            mode = CHIP8_PREDECODED;
+        }
+    } else {
+        jit.reset();
+    }
+    execMode = mode;
+
+    if (mode == CHIP8_PREDECODED) {
+        // Entries start out as OP_DECODE and get decoded on first execution
+        decoded.assign(4096, Chip8Instr());
+    } else {
+        decoded.clear();
+    }
+}
+
+template <class Q>
+void Chip8::UseQuirks() {
+    step           = &Chip8::Step<Q>;
+    runInterpreter = &Chip8::RunInterpreter<Q>;
+    runPredecoded  = &Chip8::RunPredecoded<Q>;
+}
+
+void Chip8::SetQuirks(Chip8Quirks profile) {
+    switch (profile) {
+        case CHIP8_QUIRKS_VIP:   UseQuirks<Chip8QuirksVip>();   break;
+        case CHIP8_QUIRKS_SCHIP: UseQuirks<Chip8QuirksSchip>(); break;
+        case CHIP8_QUIRKS_XO:    UseQuirks<Chip8QuirksXo>();    break;
+        default:
+            profile = CHIP8_QUIRKS_CHIP8;
+            UseQuirks<Chip8QuirksChip8>();
+            break;
+    }
+    quirks = profile;
+
+    // Decoded entries and compiled blocks have the old behaviour built in
+    if (!decoded.empty()) {
+        memset(&decoded[0], 0x00, decoded.size() * sizeof(Chip8Instr));
+    }
+    if (jit) {
+        jit->Flush();
+    }
+}
+
+void Chip8::Run(unsigned long cycles) {
+    cycleCount += cycles;
+    idleWait = false;
+#ifdef CHIP8_PROFILE
+    if (profile != NULL) {
+        for (unsigned long i = 0; i < cycles; ++i) {
+            EmulateCycle();
+        }
+        return;
+    }
+#endif
+    // Every check that misses doubles the distance to the next one, busy
+    // code pays for a few checks per Run() (and the engine restarts)
+    unsigned long slice = IDLE_SLICE;
+    while (idleSkip && cycles >= IDLE_MIN) {
+        if (SkipIdle(cycles)) {
+            idleWait = true;
+            return;
+        }
+        if (slice > cycles) {
+            slice = cycles;
+        }
+        RunEngine(slice);
+        cycles -= slice;
+        slice *= 2;
+    }
+    RunEngine(cycles);
+}
+
+void Chip8::RunEngine(unsigned long cycles) {
+    if (execMode == CHIP8_PREDECODED) {
+        (this->*runPredecoded)(cycles);
+        return;
+    }
+    if (execMode == CHIP8_JIT) {
+        jit->Run(*this, cycles);
+        return;
+    }
+
+    (this->*runInterpreter)(cycles);
+}
+
+static const Chip8QuirkFlags quirkFlags[CHIP8_QUIRKS_COUNT] = {
+    Chip8QuirkFlags::Of<Chip8QuirksChip8>(),
+    Chip8QuirkFlags::Of<Chip8QuirksVip>(),
+    Chip8QuirkFlags::Of<Chip8QuirksSchip>(),
+    Chip8QuirkFlags::Of<Chip8QuirksXo>()
+};
+
+static const char * const quirkNames[CHIP8_QUIRKS_COUNT] = { "chip8", "vip", "schip", "xo" };
+
+const Chip8QuirkFlags & Chip8GetQuirkFlags(Chip8Quirks quirks) {
+    return quirkFlags[quirks < CHIP8_QUIRKS_COUNT ? quirks : CHIP8_QUIRKS_CHIP8];
+}
+
+const char * Chip8QuirksName(Chip8Quirks quirks) {
+    return quirkNames[quirks < CHIP8_QUIRKS_COUNT ? quirks : CHIP8_QUIRKS_CHIP8];
+}
+
+bool Chip8QuirksFromName(const char * name, Chip8Quirks & quirks) {
+    for (int i = 0; i < CHIP8_QUIRKS_COUNT; ++i) {
+        if (strcmp(name, quirkNames[i]) == 0) {
+            quirks = (Chip8Quirks)i;
+            return true;
+        }
+    }
+    return false;
 }
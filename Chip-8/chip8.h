@@ -1,50 +1,319 @@
 /*
  * chip8.h
+ *  - Self contained Chip-8 core. Holds no global state and has no display
+ *    dependencies, so any number of instances can run side by side (see
+ *    chip8Emu.cpp for the GLUT front end, chip8Batch.cpp for headless runs).
  */
 
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <time.h>
+#include <memory>
+#include <vector>
+#include "chip8Decode.h"
+#include "chip8Quirks.h"
+
+// Instrumentation hooks, compiled in with -DCHIP8_PROFILE only
+#ifdef CHIP8_PROFILE
+#include "chip8Profile.h"
+#define CHIP8_PROFILE_HOOK(stmt) do { if (profile != NULL) { stmt; } } while (0)
+#else
+#define CHIP8_PROFILE_HOOK(stmt) do { } while (0)
+#endif
 
 #ifndef __CHIP8__ 
 #define __CHIP8__
 
 #define OPCODE_LEN 2
+#define TIMER_HZ   60       // Delay / sound timer rate, one tick per frame
+
+#define CHIP8_STATE_VERSION 3
+
+#define CHIP8_MEMORY    0x10000     // XO-CHIP address space, other profiles use the low 4 KB
+#define CHIP8_PLANES    2           // XO-CHIP bitplanes
+#define CHIP8_BIGFONT   0x50        // FX30 digits, 8x10 pixels, 10 bytes each
+
+class Chip8Jit;
+class Chip8Audio;
+struct Chip8IdleRegs;
+
+// Complete machine state (everything but key[] and configuration). Plain
+// data, so it can be copied and compared as bytes.
+struct Chip8State {
+    unsigned char  memory[CHIP8_MEMORY];
+    uint64_t       gfx[CHIP8_PLANES][2][64];
+    unsigned short stack[16];
+    unsigned char  V[16];
+    unsigned short I;
+    unsigned short pc;
+    unsigned short sp;
+    unsigned char  timer_delay;
+    unsigned char  timer_sound;
+    unsigned char  drawFlag;
+    unsigned char  hires;
+    unsigned char  planes;
+    unsigned char  pitch;
+    unsigned char  flags[16];
+    unsigned char  pattern[16];
+    uint64_t       rng;
+    uint64_t       cycles;
+};
+
+enum Chip8ExecMode {
+    CHIP8_INTERPRETER,      // Reference switch interpreter (EmulateCycle)
+    CHIP8_PREDECODED,       // Predecoded instruction cache, threaded dispatch
+    CHIP8_JIT               // x86-64 basic block recompiler (falls back to predecoded)
+};
+
+// Building blocks shared by Chip8 and the lane engine (chip8Lanes.h)
+
+// Generator state for a seed (splitmix64), never 0
+inline uint64_t Chip8SeedRandom(uint64_t seed) {
+    uint64_t z = seed + 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z ^= z >> 31;
+    return z != 0 ? z : 1;
+}
+
+// CXNN random byte, xorshift64*
+inline unsigned char Chip8Random(uint64_t & state) {
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return (unsigned char)((state * 0x2545F4914F6CDD1DULL) >> 56);
+}
+
+// DXYN on a packed framebuffer, returns the collision flag for VF
+template <bool wrap>
+inline unsigned char Chip8DrawSprite(uint64_t * gfx, const unsigned char * memory, unsigned short x, unsigned short y,
+                                     unsigned short height, unsigned short addr) {
+    uint64_t collision = 0;
+
+    // The start position always wraps, the sprite itself wraps or clips
+    x %= 64;
+    y %= 32;
+    for (int yline = 0; yline < height; yline++) {
+        int row = y + yline;
+        if (row >= 32) {
+            if (!wrap) {
+                break;
+            }
+            row -= 32;
+        }
+
+        // Place the sprite byte in the top bits, then move it to column x
+        uint64_t bits = (uint64_t)memory[(addr + yline) & 0x0FFF] << 56;
+        uint64_t line = wrap ? ((bits >> x) | (bits << ((64 - x) & 63))) : (bits >> x);
+
+        collision |= gfx[row] & line;
+        gfx[row]  ^= line;
+    }
+
+    return collision != 0;
+}
 
 class Chip8 {
     
     public:
     
+        Chip8();
+        ~Chip8();
+        
         bool LoadApplication(const char * filename);
+        bool LoadApplication(const unsigned char * data, long size);
         void EmulateCycle();
-        void SetKeys();
+        void SetExecMode(Chip8ExecMode mode);
+        Chip8ExecMode GetExecMode() const { return execMode; }
+        void SetQuirks(Chip8Quirks profile);   // Kept across loads, like the exec mode. Set before
+                                                // loading: sizes memory, loads the SUPER-CHIP font
+        Chip8Quirks GetQuirks() const { return quirks; }
+        void Run(unsigned long cycles);     // Execute cycles in the selected mode (counted in GetCycles())
+        void RunFrame(unsigned long cycles);// Run one 1/60 s frame worth of cycles, then tick the timers
+        void TickTimers();                  // 60 Hz timer tick
+        void SetKeys(unsigned short mask);  // key[] from a bitmask, bit n = key n
+        unsigned short GetKeys() const;
+        
+        // Wait loops (delay timer polls, FX0A) are fast-forwarded to the end
+        // of the Run() budget with the same end state (see chip8Idle.cpp).
+        // Idle() = the last Run() ended that way.
+        void SetIdleSkip(bool enable) { idleSkip = enable; }
+        bool Idle() const { return idleWait; }
+        
+        // CXNN random numbers come from a per instance generator, reset to
+        // the seed by LoadApplication(). Same seed + same input = same run.
+        void Seed(uint64_t seed);
+        uint64_t GetSeed() const { return rngSeed; }
+        uint64_t GetCycles() const { return cycleCount; }
+        
+        // Sound timer output (see chip8Audio.h), fed from TickTimers(), NULL = none
+        void AttachAudio(Chip8Audio * a) { audio = a; }
         
-        // Graphics
-        unsigned char gfx[64 * 32]; // 2048 total pixels
+#ifdef CHIP8_PROFILE
+        // Profile every instruction from now on (NULL = stop)
+        void AttachProfile(Chip8Profile * p) { profile = p; }
+#endif
+        
+        // Snapshots. Get/SetState copy the raw state (fast, in process),
+        // Save/LoadState use the versioned binary format of chip8State.cpp.
+        void GetState(Chip8State & state) const;
+        void SetState(const Chip8State & state);
+        void SaveState(std::vector<unsigned char> & out) const;
+        bool LoadState(const unsigned char * data, size_t size);
+        bool SaveState(const char * filename) const;
+        bool LoadState(const char * filename);
+        
+        // Graphics. gfx[plane][half][row], one word per row, bit 63 =
+        // leftmost pixel. Lo-res (64x32) uses rows 0-31 of half 0, hi-res
+        // (128x64) puts columns 0-63 in half 0 and 64-127 in half 1. Plane 1
+        // is only drawn to by XO-CHIP.
+        uint64_t gfx[CHIP8_PLANES][2][64];
         bool drawFlag;              // Frame ready to draw
+        
+        bool HiRes() const  { return hires; }
+        int  Width() const  { return hires ? 128 : 64; }
+        int  Height() const { return hires ? 64 : 32; }
+        
+        // Bit n = pixel set in plane n
+        unsigned char GetPixel(int x, int y) const {
+            x &= Width() - 1;
+            y &= Height() - 1;
+            return ((gfx[0][x >> 6][y] >> (63 - (x & 63))) & 1) | (((gfx[1][x >> 6][y] >> (63 - (x & 63))) & 1) << 1);
+        }
+        void UnpackFramebuffer(unsigned char * out) const;  // Width() * Height() bytes, GetPixel() values
        
         // I/O
         unsigned char key[16];      // Hex based keypad input
         
+        // State inspection
+        unsigned char  GetV(int index) const      { return V[index & 0x0F]; }
+        unsigned short GetI() const               { return I; }
+        unsigned short GetPC() const              { return pc; }
+        unsigned short GetSP() const              { return sp; }
+        unsigned short GetStack(int level) const  { return stack[level & 0x0F]; }
+        unsigned char  GetDelayTimer() const      { return timer_delay; }
+        unsigned char  GetSoundTimer() const      { return timer_sound; }
+        const unsigned char * GetMemory() const   { return memory; }    // CHIP8_MEMORY bytes
+        const unsigned char * GetPattern() const  { return pattern; }   // XO-CHIP audio, 128 1-bit samples
+        unsigned char  GetPitch() const           { return pitch; }
+        
     private:
     
+        friend class Chip8Jit;
+    
         void Initialize();          // Initialize emulation state
+        void RunEngine(unsigned long cycles);
+        
+        // One specialization per quirks profile, selected by SetQuirks()
+        template <class Q> void UseQuirks();
+        template <class Q> void Step();
+        template <class Q> void RunInterpreter(unsigned long cycles);
+        template <class Q> void RunPredecoded(unsigned long cycles);
+        
+        bool SkipIdle(unsigned long cycles);
+        bool IdleStep(Chip8IdleRegs & regs, const Chip8QuirkFlags & q) const;
+        void JitInvalidate(unsigned short addr);
+        
+        unsigned char Random() { return Chip8Random(rng); }
+        
+        // DXYN in lo-res on plane 0, returns the collision flag for VF
+        template <bool wrap>
+        unsigned char DrawSprite(unsigned short x, unsigned short y, unsigned short height, unsigned short addr) {
+            drawFlag = true;
+            return Chip8DrawSprite<wrap>(gfx[0][0], memory, x, y, height, addr);
+        }
+        
+        // DXYN for any profile: plain CHIP-8 sprites take the path above
+        template <class Q>
+        unsigned char Draw(unsigned short x, unsigned short y, unsigned short height, unsigned short addr) {
+            if (Q::isa == CHIP8_ISA_XO || (Q::isa == CHIP8_ISA_SCHIP && (hires || height == 0))) {
+                drawFlag = true;
+                return DrawExtended(x, y, height, addr, Q::wrap, Chip8AddrMask<Q>());
+            }
+            return DrawSprite<Q::wrap>(x, y, height, addr);
+        }
+        
+        // SUPER-CHIP / XO-CHIP display, see chip8Display.cpp
+        unsigned char DrawExtended(unsigned short x, unsigned short y, unsigned short height, unsigned short addr,
+                                   bool wrap, unsigned int addrMask);
+        void ClearScreen();
+        void ScrollDown(int n);
+        void ScrollUp(int n);
+        void ScrollRight();
+        void ScrollLeft();
+        void SetHires(bool enable);
+        
+        // Bytes a taken skip jumps over, from the skip at addr: XO-CHIP
+        // skips F000 NNNN as a whole
+        template <class Q>
+        unsigned short SkipLength(unsigned short addr) const {
+            if (Q::isa == CHIP8_ISA_XO && memory[(addr + 2) & 0x0FFF] == 0xF0 && memory[(addr + 3) & 0x0FFF] == 0x00) {
+                return 4;
+            }
+            return 2;
+        }
+        
+        // Every memory write goes through here to keep decoded code coherent.
+        // addr is already masked to the profile's address space, only the
+        // low 4 KB can hold code.
+        void StoreByte(unsigned int addr, unsigned char value) {
+            memory[addr] = value;
+            if (addr > 0x0FFF) {
+                return;
+            }
+            if (!decoded.empty()) {
+                decoded[addr].op = OP_DECODE;
+                decoded[(addr - 1) & 0x0FFF].op = OP_DECODE;
+            }
+            if (jit) {
+                JitInvalidate(addr);
+            }
+        }
     
         // Timers
         unsigned char timer_delay;  // Delay timer
         unsigned char timer_sound;  // Sound timer
         
         // Memory
-        unsigned char memory[4096]; // Memory (size = 4k)
+        unsigned char memory[CHIP8_MEMORY];   // 4k, 64k for XO-CHIP
         unsigned short stack[16];   // Stack (16 levels)
         
         // Registers
         unsigned char V[16];        // 16 8-bit data registers (V0 - VF)
+        unsigned char flags[16];    // SUPER-CHIP RPL user flags (FX75 / FX85)
         unsigned short I;           // Address Register
         unsigned short pc;          // Program Counter  (0x000 to 0xFFF)
         unsigned short sp;          // Stack Pointer        
         unsigned short opcode;      // Working area for active opcode
+        
+        // Extended display and audio
+        bool hires;                 // 128x64 mode (00FF)
+        unsigned char planes;       // Bitplanes drawn to (FN01), bit n = plane n
+        unsigned char pattern[16];  // XO-CHIP audio pattern (F002)
+        unsigned char pitch;        // XO-CHIP playback pitch (FX3A)
+        
+        // Determinism
+        uint64_t rngSeed;
+        uint64_t rng;               // Generator state, never 0
+        uint64_t cycleCount;        // Instructions executed by Run() since load
+        
+        // Execution
+        Chip8ExecMode  execMode;
+        Chip8Quirks    quirks;
+        void (Chip8::*step)();
+        void (Chip8::*runInterpreter)(unsigned long cycles);
+        void (Chip8::*runPredecoded)(unsigned long cycles);
+        std::vector<Chip8Instr> decoded;    // Decoded instruction per PC (empty = not in use)
+        std::unique_ptr<Chip8Jit> jit;      // Recompiler state (NULL = not in use)
+        bool idleSkip;
+        bool idleWait;                      // Last Run() ended in a wait loop
+        Chip8Audio * audio;                 // Sound output (NULL = none)
+        
+#ifdef CHIP8_PROFILE
+        Chip8Profile * profile;
+#endif
 };
 
 #endif
@@ -0,0 +1,254 @@
+/*
+ * chip8Audio.cpp
+ */
+
+#include "chip8Audio.h"
+#include "chip8.h"
+
+#include <math.h>
+#include <chrono>
+
+#define AUDIO_AMPLITUDE 8192    // Square wave level, about -12 dBFS
+#define MIXER_SLEEP_MS  2       // Mixer poll interval while the ring is empty
+#define WAV_HEADER      44
+
+static unsigned char * Put16(unsigned char * p, unsigned int v) {
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    return p + 2;
+}
+
+static unsigned char * Put32(unsigned char * p, uint32_t v) {
+    p = Put16(p, v & 0xFFFF);
+    return Put16(p, v >> 16);
+}
+
+static bool WriteWavHeader(FILE * file, unsigned int rate, uint64_t samples) {
+    unsigned char header[WAV_HEADER];
+    uint32_t data = (uint32_t)(samples * 2);
+    unsigned char * p = header;
+    memcpy(p, "RIFF", 4);   p += 4;
+    p = Put32(p, 36 + data);
+    memcpy(p, "WAVEfmt ", 8); p += 8;
+    p = Put32(p, 16);       // fmt chunk size
+    p = Put16(p, 1);        // PCM
+    p = Put16(p, 1);        // Mono
+    p = Put32(p, rate);
+    p = Put32(p, rate * 2); // Bytes per second
+    p = Put16(p, 2);        // Bytes per sample
+    p = Put16(p, 16);       // Bits per sample
+    memcpy(p, "data", 4);   p += 4;
+    Put32(p, data);
+    return fwrite(header, 1, WAV_HEADER, file) == WAV_HEADER;
+}
+
+Chip8WavSink::Chip8WavSink(const char * path) : path(path), file(NULL), rate(0), samples(0) {
+}
+
+Chip8WavSink::~Chip8WavSink() {
+    Close();
+}
+
+bool Chip8WavSink::Open(unsigned int sampleRate) {
+    file = fopen(path.c_str(), "wb");
+    if (file == NULL) {
+        return false;
+    }
+    rate    = sampleRate;
+    samples = 0;
+    return WriteWavHeader(file, rate, 0);
+}
+
+void Chip8WavSink::Write(const short * s, size_t count) {
+    if (file == NULL) {
+        return;
+    }
+    // Little endian whatever the host is
+    unsigned char bytes[1024];
+    while (count > 0) {
+        size_t n = count < sizeof(bytes) / 2 ? count : sizeof(bytes) / 2;
+        for (size_t i = 0; i < n; ++i) {
+            Put16(&bytes[i * 2], (unsigned short)s[i]);
+        }
+        fwrite(bytes, 2, n, file);
+        samples += n;
+        s       += n;
+        count   -= n;
+    }
+}
+
+void Chip8WavSink::Close() {
+    if (file == NULL) {
+        return;
+    }
+    rewind(file);
+    WriteWavHeader(file, rate, samples);
+    fclose(file);
+    file = NULL;
+}
+
+Chip8Audio::Chip8Audio(Chip8AudioSink * sink, unsigned int rate, unsigned int tone)
+    : head(0), tail(0), lastTick(0), sounding(false), sentPitch(0), sink(sink), rate(rate), tone(tone),
+      stop(false), buffer(rate / TIMER_HZ + 1), edgeCount(0), tickStart(0), sampleCarry(0), phase(0) {
+    memset(sentPattern, 0x00, sizeof(sentPattern));
+    memset(&voice, 0x00, sizeof(voice));
+    voice.type = CHIP8_AUDIO_OFF;
+}
+
+Chip8Audio::~Chip8Audio() {
+    Finish();
+}
+
+bool Chip8Audio::Start() {
+    if (!sink->Open(rate)) {
+        return false;
+    }
+    stop.store(false, std::memory_order_relaxed);
+    thread = std::thread(&Chip8Audio::Mixer, this);
+    return true;
+}
+
+void Chip8Audio::Finish() {
+    if (!thread.joinable()) {
+        return;
+    }
+    stop.store(true, std::memory_order_release);
+    thread.join();
+    sink->Close();
+}
+
+void Chip8Audio::Tick(uint64_t cycle, bool on, unsigned char pitch, const unsigned char * pattern) {
+    // The sound timer counts ticks: sound left at the end of a frame played
+    // for the whole frame, so the edges go at its start. A snapshot load or
+    // rewind can move the cycle count back, the edge then goes at the tick.
+    uint64_t start = cycle >= lastTick ? lastTick : cycle;
+
+    Chip8AudioEvent e;
+    if (on && (!sounding || pitch != sentPitch || memcmp(pattern, sentPattern, sizeof(sentPattern)) != 0)) {
+        e.cycle = start;
+        e.type  = CHIP8_AUDIO_ON;
+        e.pitch = pitch;
+        memcpy(e.pattern, pattern, sizeof(e.pattern));
+        Push(e);
+        sounding  = true;
+        sentPitch = pitch;
+        memcpy(sentPattern, pattern, sizeof(sentPattern));
+    } else if (!on && sounding) {
+        memset(&e, 0x00, sizeof(e));
+        e.cycle = start;
+        e.type  = CHIP8_AUDIO_OFF;
+        Push(e);
+        sounding = false;
+    }
+
+    memset(&e, 0x00, sizeof(e));
+    e.cycle = cycle;
+    e.type  = CHIP8_AUDIO_TICK;
+    Push(e);
+    lastTick = cycle;
+}
+
+void Chip8Audio::Push(const Chip8AudioEvent & e) {
+    unsigned int h = head.load(std::memory_order_relaxed);
+    while (h - tail.load(std::memory_order_acquire) == RING_SIZE) {
+        std::this_thread::yield();
+    }
+    ring[h % RING_SIZE] = e;
+    head.store(h + 1, std::memory_order_release);
+}
+
+bool Chip8Audio::Pop(Chip8AudioEvent & e) {
+    unsigned int t = tail.load(std::memory_order_relaxed);
+    if (t == head.load(std::memory_order_acquire)) {
+        return false;
+    }
+    e = ring[t % RING_SIZE];
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+}
+
+void Chip8Audio::Mixer() {
+    for (;;) {
+        // Checked before the ring, so events pushed before Finish() still play
+        bool done = stop.load(std::memory_order_acquire);
+
+        Chip8AudioEvent e;
+        if (!Pop(e)) {
+            if (done) {
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(MIXER_SLEEP_MS));
+            continue;
+        }
+
+        if (e.type != CHIP8_AUDIO_TICK) {
+            // At most one edge per tick comes in, the latest wins otherwise
+            edges[edgeCount < MAX_EDGES ? edgeCount++ : MAX_EDGES - 1] = e;
+            continue;
+        }
+
+        // One tick of samples, rate / 60 with the remainder carried
+        size_t count = (rate + sampleCarry) / TIMER_HZ;
+        sampleCarry  = (rate + sampleCarry) % TIMER_HZ;
+
+        // Edges split the tick where their cycle falls between the two ticks
+        uint64_t span = e.cycle > tickStart ? e.cycle - tickStart : 0;
+        size_t mixed = 0;
+        for (unsigned int i = 0; i < edgeCount; ++i) {
+            size_t at = 0;
+            if (span > 0 && edges[i].cycle > tickStart) {
+                uint64_t offset = (edges[i].cycle - tickStart) * count / span;
+                at = offset < count ? (size_t)offset : count;
+            }
+            if (at > mixed) {
+                Render(&buffer[mixed], at - mixed);
+                mixed = at;
+            }
+            if (edges[i].type == CHIP8_AUDIO_ON && voice.type != CHIP8_AUDIO_ON) {
+                phase = 0;      // Notes start at the beginning of a period
+            }
+            voice = edges[i];
+        }
+        Render(&buffer[mixed], count - mixed);
+        edgeCount = 0;
+        tickStart = e.cycle;
+
+        sink->Write(&buffer[0], count);
+    }
+}
+
+void Chip8Audio::Render(short * out, size_t count) {
+    if (voice.type != CHIP8_AUDIO_ON) {
+        memset(out, 0x00, count * sizeof(short));
+        return;
+    }
+
+    bool pattern = false;
+    for (int i = 0; i < 16; ++i) {
+        pattern |= voice.pattern[i] != 0;
+    }
+
+    if (pattern) {
+        // 128 one bit samples, bit 7 of byte 0 first
+        double step = 4000.0 * pow(2.0, (voice.pitch - 64) / 48.0) / rate;
+        phase -= floor(phase / 128) * 128;
+        for (size_t i = 0; i < count; ++i) {
+            unsigned int bit = (unsigned int)phase;
+            out[i] = ((voice.pattern[bit >> 3] >> (7 - (bit & 7))) & 1) ? AUDIO_AMPLITUDE : -AUDIO_AMPLITUDE;
+            phase += step;
+            if (phase >= 128) {
+                phase -= 128;
+            }
+        }
+    } else {
+        double step = (double)tone / rate;
+        phase -= floor(phase);
+        for (size_t i = 0; i < count; ++i) {
+            out[i] = phase < 0.5 ? AUDIO_AMPLITUDE : -AUDIO_AMPLITUDE;
+            phase += step;
+            if (phase >= 1) {
+                phase -= 1;
+            }
+        }
+    }
+}
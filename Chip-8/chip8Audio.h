@@ -0,0 +1,144 @@
+/*
+ * chip8Audio.h
+ *  - Sound output. The emulation thread only pushes small fixed size events
+ *    into a lock-free single producer / single consumer ring: sound timer
+ *    on/off edges and one tick event per 60 Hz timer tick, all timestamped
+ *    in emulated cycles. A mixer thread turns them into 16 bit mono samples
+ *    and hands those to a sink (WAV file, null).
+ *
+ *    Every tick is 1/60 s of sound, whatever the CPU rate, so audio follows
+ *    emulated time: turbo and unlimited speed play back at normal speed in
+ *    a WAV file. Edges are placed inside a tick by their cycle.
+ *
+ *    CHIP-8 and SUPER-CHIP play a square wave. XO-CHIP plays its 128 bit
+ *    pattern buffer at 4000 * 2 ^ ((pitch - 64) / 48) bits per second, an
+ *    all zero pattern (never loaded) plays the square wave too.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef __CHIP8AUDIO__
+#define __CHIP8AUDIO__
+
+#define CHIP8_AUDIO_RATE  44100     // Default sample rate
+#define CHIP8_AUDIO_TONE  440       // Default square wave frequency
+
+enum Chip8AudioEventType {
+    CHIP8_AUDIO_TICK,       // Timer tick, cycle = Chip8::GetCycles()
+    CHIP8_AUDIO_ON,         // Sound starts (or changes pattern / pitch)
+    CHIP8_AUDIO_OFF         // Sound stops
+};
+
+struct Chip8AudioEvent {
+    uint64_t      cycle;
+    unsigned char type;
+    unsigned char pitch;        // ON: XO-CHIP pitch
+    unsigned char pattern[16];  // ON: XO-CHIP pattern, all zero = square wave
+};
+
+// Where the mixer puts its samples. Write() runs on the mixer thread.
+class Chip8AudioSink {
+
+    public:
+
+        virtual ~Chip8AudioSink() { }
+        virtual bool Open(unsigned int rate) = 0;
+        virtual void Write(const short * samples, size_t count) = 0;
+        virtual void Close() = 0;
+};
+
+// Discards the samples, keeps count
+class Chip8NullSink : public Chip8AudioSink {
+
+    public:
+
+        Chip8NullSink() : samples(0) { }
+
+        bool Open(unsigned int) { return true; }
+        void Write(const short *, size_t count) { samples += count; }
+        void Close() { }
+
+        uint64_t GetSamples() const { return samples; }
+
+    private:
+
+        uint64_t samples;
+};
+
+// 16 bit mono PCM .wav file, the sizes in the header are filled in by Close()
+class Chip8WavSink : public Chip8AudioSink {
+
+    public:
+
+        Chip8WavSink(const char * path);
+        ~Chip8WavSink();
+
+        bool Open(unsigned int rate);
+        void Write(const short * samples, size_t count);
+        void Close();
+
+    private:
+
+        std::string  path;
+        FILE *       file;
+        unsigned int rate;
+        uint64_t     samples;
+};
+
+class Chip8Audio {
+
+    public:
+
+        Chip8Audio(Chip8AudioSink * sink, unsigned int rate = CHIP8_AUDIO_RATE, unsigned int tone = CHIP8_AUDIO_TONE);
+        ~Chip8Audio();
+
+        bool Start();           // Opens the sink, starts the mixer thread
+        void Finish();          // Mixes what is queued, stops the thread, closes the sink
+
+        // Emulation thread, once per timer tick (Chip8::TickTimers()): the
+        // sound state of the frame that just ended. Never allocates or
+        // prints, only waits when the mixer is a whole ring behind.
+        void Tick(uint64_t cycle, bool on, unsigned char pitch, const unsigned char * pattern);
+
+    private:
+
+        enum { RING_SIZE = 1024, MAX_EDGES = 8 };
+
+        void Push(const Chip8AudioEvent & e);
+        bool Pop(Chip8AudioEvent & e);
+
+        void Mixer();
+        void Render(short * out, size_t count);
+
+        // Ring, head written by the emulation thread, tail by the mixer
+        Chip8AudioEvent          ring[RING_SIZE];
+        alignas(64) std::atomic<unsigned int> head;
+        alignas(64) std::atomic<unsigned int> tail;
+
+        // Emulation thread
+        uint64_t      lastTick;
+        bool          sounding;
+        unsigned char sentPitch;
+        unsigned char sentPattern[16];
+
+        // Mixer thread
+        Chip8AudioSink *   sink;
+        unsigned int       rate;
+        unsigned int       tone;
+        std::thread        thread;
+        std::atomic<bool>  stop;
+        std::vector<short> buffer;              // One tick of samples
+        Chip8AudioEvent    edges[MAX_EDGES];    // Edges of the tick being mixed
+        unsigned int       edgeCount;
+        uint64_t           tickStart;           // Cycle of the previous tick
+        unsigned int       sampleCarry;         // rate % 60 accumulator
+        Chip8AudioEvent    voice;               // Last edge, type ON = playing
+        double             phase;               // Square wave: periods, pattern: bits
+};
+
+#endif
@@ -0,0 +1,283 @@
+/*
+ * chip8Batch.cpp
+ *  - Headless batch runner. Runs every ROM (times the instance count) for a
+ *    fixed cycle and/or frame budget across a work-stealing thread pool, then
+ *    writes the final machine state and framebuffer of every job. Frames are
+ *    1/60 s of emulated time at the selected CPU rate, same as the emulator.
+ *
+ *    With -a every job also mixes its sound (chip8Audio.h), into
+ *    <rom>.<n>.wav with -o, else into a null sink.
+ *
+ *    Built with -DCHIP8_PROFILE (plus chip8Profile.cpp) every job is
+ *    profiled and -o also gets <rom>.<n>.profile.json / .folded.
+ *
+ *  Build: g++ -O2 -pthread chip8.cpp chip8Predecode.cpp chip8Idle.cpp chip8Display.cpp chip8Jit.cpp chip8Scheduler.cpp chip8State.cpp chip8Audio.cpp chip8Rom.cpp workPool.cpp chip8Batch.cpp -o chip8-batch
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <atomic>
+#include <thread>
+#include <string>
+#include <vector>
+#include "chip8.h"
+#include "chip8Audio.h"
+#include "chip8Rom.h"
+#include "chip8Scheduler.h"
+#include "workPool.h"
+
+struct BatchRom {
+    std::string                path;
+    std::string                name;
+    std::vector<unsigned char> image;
+    Chip8Quirks                quirks;
+};
+
+struct BatchOptions {
+    unsigned long long maxCycles;   // Cycle budget per job
+    unsigned long long maxFrames;   // Frame budget per job (0 = cycles only)
+    unsigned long      hz;          // Instructions per emulated second
+    uint64_t           seed;        // RNG seed of instance 0, instance n uses seed + n
+    unsigned int       instances;   // Jobs per ROM
+    unsigned int       threads;
+    Chip8ExecMode      mode;
+    bool               autoQuirks;  // Profile per ROM (DetectQuirks), else quirks
+    Chip8Quirks        quirks;
+    bool               idleSkip;    // Fast-forward wait loops
+    const char *       outDir;      // NULL = no per job files
+    unsigned int       audioRate;   // Sample rate, 0 = no sound
+};
+
+static std::atomic<unsigned long long> totalCycles(0);
+
+static void WriteState(const Chip8 & c8, const char * path, unsigned long long cycles, unsigned long long frames) {
+    FILE * out = fopen(path, "w");
+    if (out == NULL) {
+        fprintf(stderr, "Unable to write %s\n", path);
+        return;
+    }
+
+    fprintf(out, "cycles %llu\nframes %llu\n", cycles, frames);
+    fprintf(out, "pc %03X\nI %03X\nsp %X\n", c8.GetPC(), c8.GetI(), c8.GetSP());
+    fprintf(out, "delay %u\nsound %u\n", c8.GetDelayTimer(), c8.GetSoundTimer());
+    for (int i = 0; i < 16; ++i) {
+        fprintf(out, "V%X %02X\n", i, c8.GetV(i));
+    }
+    for (int i = 0; i < c8.GetSP(); ++i) {
+        fprintf(out, "stack%X %03X\n", i, c8.GetStack(i));
+    }
+    fclose(out);
+}
+
+static void WriteFramebuffer(const Chip8 & c8, const char * path) {
+    FILE * out = fopen(path, "w");
+    if (out == NULL) {
+        fprintf(stderr, "Unable to write %s\n", path);
+        return;
+    }
+
+    // Plain PBM at the current resolution, 1 = set pixel in any plane
+    fprintf(out, "P1\n%d %d\n", c8.Width(), c8.Height());
+    for (int y = 0; y < c8.Height(); y++) {
+        for (int x = 0; x < c8.Width(); x++) {
+            fputc(c8.GetPixel(x, y) ? '1' : '0', out);
+        }
+        fputc('\n', out);
+    }
+    fclose(out);
+}
+
+static void RunJob(const BatchRom * rom, unsigned int instance, const BatchOptions * opts) {
+    Chip8 * c8 = new Chip8();
+    c8->Seed(opts->seed + instance);
+    c8->SetQuirks(rom->quirks);
+    if (!c8->LoadApplication(rom->image.empty() ? NULL : &rom->image[0], (long)rom->image.size())) {
+        fprintf(stderr, "%s: ROM too big for memory\n", rom->path.c_str());
+        delete c8;
+        return;
+    }
+    c8->SetExecMode(opts->mode);
+    c8->SetIdleSkip(opts->idleSkip);
+#ifdef CHIP8_PROFILE
+    Chip8Profile * profile = new Chip8Profile();
+    c8->AttachProfile(profile);
+#endif
+
+    Chip8AudioSink * sink  = NULL;
+    Chip8Audio *     audio = NULL;
+    if (opts->audioRate != 0) {
+        if (opts->outDir != NULL) {
+            char path[4096];
+            snprintf(path, sizeof(path), "%s/%s.%u.wav", opts->outDir, rom->name.c_str(), instance);
+            sink = new Chip8WavSink(path);
+        } else {
+            sink = new Chip8NullSink();
+        }
+        audio = new Chip8Audio(sink, opts->audioRate);
+        if (audio->Start()) {
+            c8->AttachAudio(audio);
+        } else {
+            fprintf(stderr, "%s: unable to open the audio output\n", rom->path.c_str());
+        }
+    }
+
+    // Whole frames while the budgets allow, the cycle budget may end with a
+    // partial frame (no timer tick)
+    Chip8Scheduler scheduler(opts->hz);
+    unsigned long long cycles = 0;
+    unsigned long long frames = 0;
+    while (cycles < opts->maxCycles && (opts->maxFrames == 0 || frames < opts->maxFrames)) {
+        unsigned long long batch = scheduler.NextFrameCycles();
+        if (batch > opts->maxCycles - cycles) {
+            c8->Run(opts->maxCycles - cycles);
+            cycles = opts->maxCycles;
+            break;
+        }
+        c8->RunFrame(batch);
+        cycles += batch;
+        frames++;
+    }
+    totalCycles += cycles;
+
+    if (audio != NULL) {
+        audio->Finish();
+        delete audio;
+        delete sink;
+    }
+
+    if (opts->outDir != NULL) {
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s.%u.state", opts->outDir, rom->name.c_str(), instance);
+        WriteState(*c8, path, cycles, frames);
+        snprintf(path, sizeof(path), "%s/%s.%u.pbm", opts->outDir, rom->name.c_str(), instance);
+        WriteFramebuffer(*c8, path);
+#ifdef CHIP8_PROFILE
+        snprintf(path, sizeof(path), "%s/%s.%u.profile.json", opts->outDir, rom->name.c_str(), instance);
+        profile->WriteJson(path);
+        snprintf(path, sizeof(path), "%s/%s.%u.folded", opts->outDir, rom->name.c_str(), instance);
+        profile->WriteFolded(path, rom->name);
+#endif
+    }
+
+    printf("%s #%u: %llu cycles, %llu frames, pc %03X\n", rom->name.c_str(), instance, cycles, frames, c8->GetPC());
+#ifdef CHIP8_PROFILE
+    delete profile;
+#endif
+    delete c8;
+}
+
+static void Usage() {
+    printf("Usage: chip8-batch [options] rom|directory...\n\n");
+    printf("  -c cycles     cycle budget per job (default 1000000)\n");
+    printf("  -f frames     stop a job after this many 60 Hz frames\n");
+    printf("  -z hz         CPU instructions per second (default %d)\n", CHIP8_DEFAULT_HZ);
+    printf("  -n instances  jobs per ROM (default 1)\n");
+    printf("  -s seed       random number seed, + instance number (default 1)\n");
+    printf("  -j threads    worker threads (default: all cores)\n");
+    printf("  -m mode       interpreter | predecoded | jit (default predecoded)\n");
+    printf("  -q quirks     chip8 | vip | schip | xo | auto (default auto: per ROM)\n");
+    printf("  -i 0|1        fast-forward wait loops (default 1)\n");
+    printf("  -a rate       mix the sound at this sample rate, -o gets <rom>.<n>.wav\n");
+    printf("  -o directory  write <rom>.<n>.state and <rom>.<n>.pbm per job\n\n");
+}
+
+int main(int argc, char **argv) {
+
+    BatchOptions opts;
+    opts.maxCycles = 1000000;
+    opts.maxFrames = 0;
+    opts.hz        = CHIP8_DEFAULT_HZ;
+    opts.seed      = 1;
+    opts.instances = 1;
+    opts.threads   = std::thread::hardware_concurrency();
+    opts.outDir    = NULL;
+    opts.audioRate = 0;
+    opts.mode      = CHIP8_PREDECODED;
+    opts.autoQuirks = true;
+    opts.quirks    = CHIP8_QUIRKS_CHIP8;
+    opts.idleSkip  = true;
+
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; ++i) {
+        if (argv[i][0] == '-' && i + 1 < argc) {
+            const char * value = argv[++i];
+            switch (argv[i - 1][1]) {
+                case 'c': opts.maxCycles = strtoull(value, NULL, 10); break;
+                case 'f': opts.maxFrames = strtoull(value, NULL, 10); break;
+                case 'z': opts.hz        = strtoul(value, NULL, 10);  break;
+                case 's': opts.seed      = strtoull(value, NULL, 10); break;
+                case 'n': opts.instances = (unsigned int)atoi(value);  break;
+                case 'j': opts.threads   = (unsigned int)atoi(value);  break;
+                case 'o': opts.outDir    = value;                      break;
+                case 'a': opts.audioRate = (unsigned int)atoi(value);  break;
+                case 'q': {
+                    opts.autoQuirks = strcmp(value, "auto") == 0;
+                    if (!opts.autoQuirks && !Chip8QuirksFromName(value, opts.quirks)) {
+                        Usage();
+                        return 1;
+                    }
+                    break;
+                }
+                case 'i': opts.idleSkip  = atoi(value) != 0;           break;
+                case 'm': {
+                    if (strcmp(value, "interpreter") == 0) {
+                        opts.mode = CHIP8_INTERPRETER;
+                    } else if (strcmp(value, "predecoded") == 0) {
+                        opts.mode = CHIP8_PREDECODED;
+                    } else if (strcmp(value, "jit") == 0) {
+                        opts.mode = CHIP8_JIT;
+                    } else {
+                        Usage();
+                        return 1;
+                    }
+                    break;
+                }
+                default:  Usage(); return 1;
+            }
+        } else if (argv[i][0] == '-') {
+            Usage();
+            return 1;
+        } else if (!ListRoms(argv[i], paths)) {
+            fprintf(stderr, "Unable to open %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    if (paths.empty() || opts.hz == 0) {
+        Usage();
+        return 1;
+    }
+
+    // Every ROM is read once and shared read-only by all of its jobs
+    std::vector<BatchRom> roms(paths.size());
+    for (size_t i = 0; i < paths.size(); ++i) {
+        roms[i].path = paths[i];
+        roms[i].name = RomName(paths[i]);
+        if (!ReadRomFile(paths[i], roms[i].image)) {
+            fprintf(stderr, "Unable to read %s\n", paths[i].c_str());
+            return 1;
+        }
+        roms[i].quirks = opts.autoQuirks ? DetectQuirks(roms[i].image) : opts.quirks;
+    }
+
+    WorkPool pool(opts.threads);
+    for (size_t r = 0; r < roms.size(); ++r) {
+        for (unsigned int n = 0; n < opts.instances; ++n) {
+            const BatchRom * rom = &roms[r];
+            const BatchOptions * o = &opts;
+            pool.Submit([rom, n, o]() { RunJob(rom, n, o); });
+        }
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    pool.Run();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("%zu jobs on %u threads: %llu cycles in %.3f s (%.1f M cycles/s)\n",
+           roms.size() * opts.instances, pool.Threads(), totalCycles.load(), seconds,
+           seconds > 0 ? totalCycles.load() / seconds / 1e6 : 0.0);
+
+    return 0;
+}
@@ -0,0 +1,352 @@
+/*
+ * chip8Bench.cpp
+ *  - Throughput benchmark over a ROM corpus. Every ROM runs headless for a
+ *    fixed cycle count with a scripted key sequence, once per repeat and
+ *    per exec mode, on a fresh instance with a fixed seed, so runs are
+ *    comparable across commits. Only the Run() calls are timed.
+ *
+ *    Reports instructions per second and ns per instruction per ROM (median
+ *    of the repeats) and in aggregate, the run to run variation (coefficient
+ *    of variation), and the final state hash, which must be the same in
+ *    every mode. -o writes the same numbers as JSON.
+ *
+ *    The lanes mode (not run by default) steps -l instances in lockstep
+ *    with Chip8Lanes, every lane on the same key script, and counts lane
+ *    instructions. Its state hash is the one of lane 0. Lanes only have the
+ *    chip8 quirks profile, ROMs run with another one aren't compared.
+ *
+ *  Build: g++ -O2 chip8.cpp chip8Predecode.cpp chip8Idle.cpp chip8Display.cpp chip8Jit.cpp chip8Scheduler.cpp chip8State.cpp chip8Audio.cpp chip8Input.cpp chip8Rom.cpp chip8Lanes.cpp chip8Bench.cpp -o chip8-bench
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "chip8.h"
+#include "chip8Input.h"
+#include "chip8Lanes.h"
+#include "chip8Rom.h"
+#include "chip8Scheduler.h"
+
+#define MAX_MODES  4
+#define MODE_LANES 3
+
+static const char * const modeNames[MAX_MODES] = { "interpreter", "predecoded", "jit", "lanes" };
+
+struct BenchOptions {
+    unsigned long long cycles;      // Per run
+    unsigned int       repeats;
+    unsigned long      hz;
+    uint64_t           seed;
+    unsigned int       lanes;       // Instances in the lanes mode
+    bool               idleSkip;    // Fast-forward wait loops (not in the lanes mode)
+    bool               autoQuirks;  // Profile per ROM (DetectQuirks), else quirks
+    Chip8Quirks        quirks;
+    bool               modes[MAX_MODES];
+    const char *       jsonFile;
+};
+
+struct BenchResult {
+    std::string         name;
+    std::vector<double> seconds;    // One per repeat
+    uint64_t            state;      // Final state hash
+};
+
+// Key script, a function of the frame number only: every 30 frames the
+// next key is held for 6 frames. Enough to get past title screens and
+// FX0A waits in most ROMs.
+static unsigned short ScriptKeys(unsigned long long frame) {
+    if (frame % 30 >= 6) {
+        return 0;
+    }
+    return 1 << ((frame / 30) % 16);
+}
+
+static double RunOnce(const std::vector<unsigned char> & rom, Chip8ExecMode mode, Chip8Quirks quirks, const BenchOptions & opts, uint64_t & state) {
+    Chip8 * c8 = new Chip8();
+    c8->Seed(opts.seed);
+    c8->SetExecMode(mode);
+    c8->SetQuirks(quirks);
+    c8->SetIdleSkip(opts.idleSkip);
+    c8->LoadApplication(rom.empty() ? NULL : &rom[0], (long)rom.size());
+
+    Chip8Scheduler scheduler(opts.hz);
+    unsigned long long frame = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    while (c8->GetCycles() < opts.cycles) {
+        unsigned long long batch = std::min<unsigned long long>(scheduler.NextFrameCycles(), opts.cycles - c8->GetCycles());
+        c8->SetKeys(ScriptKeys(frame++));
+        c8->RunFrame((unsigned long)batch);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::vector<unsigned char> data;
+    c8->SaveState(data);
+    state = Chip8InputLog::HashRom(&data[0], (long)data.size());
+    delete c8;
+    return seconds;
+}
+
+static double RunLanes(const std::vector<unsigned char> & rom, const BenchOptions & opts, uint64_t & state) {
+    Chip8Lanes * lanes = new Chip8Lanes(opts.lanes);
+    lanes->Seed(opts.seed);
+    lanes->LoadApplication(rom.empty() ? NULL : &rom[0], (long)rom.size());
+
+    Chip8Scheduler scheduler(opts.hz);
+    unsigned long long frame = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    while (lanes->GetCycles() < opts.cycles) {
+        unsigned long long batch = std::min<unsigned long long>(scheduler.NextFrameCycles(), opts.cycles - lanes->GetCycles());
+        unsigned short keys = ScriptKeys(frame++);
+        for (unsigned int l = 0; l < opts.lanes; ++l) {
+            lanes->SetKeys(l, keys);
+        }
+        lanes->RunFrame((unsigned long)batch);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // Lane 0 runs with opts.seed, same as the other modes
+    Chip8State lane0;
+    lanes->GetState(0, lane0);
+    Chip8 * c8 = new Chip8();
+    c8->SetState(lane0);
+    std::vector<unsigned char> data;
+    c8->SaveState(data);
+    state = Chip8InputLog::HashRom(&data[0], (long)data.size());
+    delete c8;
+    delete lanes;
+    return seconds;
+}
+
+static double Median(std::vector<double> v) {
+    std::sort(v.begin(), v.end());
+    size_t n = v.size();
+    return (n % 2) ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+// Coefficient of variation, percent
+static double Variation(const std::vector<double> & v) {
+    double mean = 0;
+    for (size_t i = 0; i < v.size(); ++i) {
+        mean += v[i];
+    }
+    mean /= v.size();
+
+    double var = 0;
+    for (size_t i = 0; i < v.size(); ++i) {
+        var += (v[i] - mean) * (v[i] - mean);
+    }
+    var /= v.size() > 1 ? v.size() - 1 : 1;
+    return mean > 0 ? sqrt(var) / mean * 100 : 0;
+}
+
+static void JsonString(FILE * out, const std::string & s) {
+    fputc('"', out);
+    for (size_t i = 0; i < s.size(); ++i) {
+        unsigned char ch = s[i];
+        if (ch == '"' || ch == '\\') {
+            fprintf(out, "\\%c", ch);
+        } else if (ch < 0x20) {
+            fprintf(out, "\\u%04x", ch);
+        } else {
+            fputc(ch, out);
+        }
+    }
+    fputc('"', out);
+}
+
+static void Usage() {
+    printf("Usage: chip8-bench [options] rom|directory...\n\n");
+    printf("  -c cycles     cycles per run (default 2000000)\n");
+    printf("  -r repeats    runs per ROM and mode (default 5)\n");
+    printf("  -m modes      comma separated: interpreter,predecoded,jit,lanes (default all but lanes)\n");
+    printf("  -l lanes      instances in the lanes mode (default 256)\n");
+    printf("  -z hz         CPU instructions per second, sets the frame size (default %d)\n", CHIP8_DEFAULT_HZ);
+    printf("  -s seed       random number seed (default 1)\n");
+    printf("  -i 0|1        fast-forward wait loops (default 1)\n");
+    printf("  -q quirks     chip8 | vip | schip | xo | auto (default auto: per ROM)\n");
+    printf("  -o file       write a JSON summary\n\n");
+}
+
+int main(int argc, char **argv) {
+
+    BenchOptions opts;
+    opts.cycles   = 2000000;
+    opts.repeats  = 5;
+    opts.hz       = CHIP8_DEFAULT_HZ;
+    opts.seed     = 1;
+    opts.lanes    = 256;
+    opts.idleSkip = true;
+    opts.autoQuirks = true;
+    opts.quirks   = CHIP8_QUIRKS_CHIP8;
+    opts.jsonFile = NULL;
+    for (int m = 0; m < MAX_MODES; ++m) {
+        opts.modes[m] = (m != MODE_LANES);
+    }
+
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; ++i) {
+        if (argv[i][0] == '-' && i + 1 < argc) {
+            const char * value = argv[++i];
+            switch (argv[i - 1][1]) {
+                case 'c': opts.cycles   = strtoull(value, NULL, 10);      break;
+                case 'r': opts.repeats  = (unsigned int)atoi(value);      break;
+                case 'z': opts.hz       = strtoul(value, NULL, 10);       break;
+                case 's': opts.seed     = strtoull(value, NULL, 10);      break;
+                case 'l': opts.lanes    = (unsigned int)atoi(value);      break;
+                case 'i': opts.idleSkip = atoi(value) != 0;               break;
+                case 'q': {
+                    opts.autoQuirks = strcmp(value, "auto") == 0;
+                    if (!opts.autoQuirks && !Chip8QuirksFromName(value, opts.quirks)) {
+                        Usage();
+                        return 1;
+                    }
+                    break;
+                }
+                case 'o': opts.jsonFile = value;                          break;
+                case 'm': {
+                    std::string list = std::string(",") + value + ",";
+                    for (int m = 0; m < MAX_MODES; ++m) {
+                        opts.modes[m] = list.find(std::string(",") + modeNames[m] + ",") != std::string::npos;
+                    }
+                    break;
+                }
+                default:  Usage(); return 1;
+            }
+        } else if (argv[i][0] == '-') {
+            Usage();
+            return 1;
+        } else if (!ListRoms(argv[i], paths)) {
+            fprintf(stderr, "Unable to open %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    if (paths.empty() || opts.repeats == 0 || opts.hz == 0 || opts.lanes == 0) {
+        Usage();
+        return 1;
+    }
+
+    std::vector<std::vector<unsigned char> > roms(paths.size());
+    std::vector<Chip8Quirks> quirks(paths.size(), opts.quirks);
+    for (size_t i = 0; i < paths.size(); ++i) {
+        if (!ReadRomFile(paths[i], roms[i])) {
+            fprintf(stderr, "Unable to read %s\n", paths[i].c_str());
+            return 1;
+        }
+        if (opts.autoQuirks) {
+            quirks[i] = DetectQuirks(roms[i]);
+        }
+    }
+
+    // results[mode][rom]
+    std::vector<std::vector<BenchResult> > results(MAX_MODES);
+    for (int m = 0; m < MAX_MODES; ++m) {
+        if (!opts.modes[m]) {
+            continue;
+        }
+        results[m].resize(roms.size());
+        for (size_t r = 0; r < roms.size(); ++r) {
+            BenchResult & res = results[m][r];
+            res.name = RomName(paths[r]);
+            for (unsigned int k = 0; k < opts.repeats; ++k) {
+                if (m == MODE_LANES) {
+                    res.seconds.push_back(RunLanes(roms[r], opts, res.state));
+                } else {
+                    res.seconds.push_back(RunOnce(roms[r], (Chip8ExecMode)m, quirks[r], opts, res.state));
+                }
+            }
+        }
+    }
+
+    FILE * json = NULL;
+    if (opts.jsonFile != NULL) {
+        json = fopen(opts.jsonFile, "w");
+        if (json == NULL) {
+            fprintf(stderr, "Unable to write %s\n", opts.jsonFile);
+            return 1;
+        }
+        fprintf(json, "{\n  \"cycles\": %llu,\n  \"repeats\": %u,\n  \"hz\": %lu,\n  \"seed\": %llu,\n  \"lanes\": %u,\n  \"idle_skip\": %s,\n  \"modes\": [",
+                opts.cycles, opts.repeats, opts.hz, (unsigned long long)opts.seed, opts.lanes, opts.idleSkip ? "true" : "false");
+    }
+
+    int mismatches = 0;
+    bool firstMode = true;
+    for (int m = 0; m < MAX_MODES; ++m) {
+        if (!opts.modes[m]) {
+            continue;
+        }
+
+        // Aggregate per repeat, so its variation covers the whole corpus
+        std::vector<double> totals(opts.repeats, 0.0);
+        for (size_t r = 0; r < results[m].size(); ++r) {
+            for (unsigned int k = 0; k < opts.repeats; ++k) {
+                totals[k] += results[m][r].seconds[k];
+            }
+        }
+        double perRom = (double)opts.cycles * (m == MODE_LANES ? opts.lanes : 1);     // Lane instructions
+        double total  = Median(totals);
+        double instrs = perRom * results[m].size();
+
+        if (m == MODE_LANES) {
+            printf("\n%s, %u x %llu cycles x %u runs\n", modeNames[m], opts.lanes, opts.cycles, opts.repeats);
+        } else {
+            printf("\n%s, %llu cycles x %u runs\n", modeNames[m], opts.cycles, opts.repeats);
+        }
+        printf("  %-48s %10s %9s %7s  %s\n", "ROM", "M instr/s", "ns/instr", "cv %", "state");
+        if (json != NULL) {
+            fprintf(json, "%s\n    {\n      \"mode\": \"%s\",\n      \"ips\": %.0f,\n      \"ns_per_instr\": %.4f,\n      \"cv_percent\": %.3f,\n      \"roms\": [",
+                    firstMode ? "" : ",", modeNames[m], total > 0 ? instrs / total : 0.0, total * 1e9 / instrs, Variation(totals));
+        }
+        firstMode = false;
+
+        for (size_t r = 0; r < results[m].size(); ++r) {
+            const BenchResult & res = results[m][r];
+            double median = Median(res.seconds);
+
+            // Every mode must end in the state of the first one
+            bool same = true;
+            for (int ref = 0; ref < m && (m != MODE_LANES || quirks[r] == CHIP8_QUIRKS_CHIP8); ++ref) {
+                if (opts.modes[ref] && results[ref][r].state != res.state) {
+                    same = false;
+                }
+            }
+            if (!same) {
+                mismatches++;
+            }
+
+            printf("  %-48s %10.1f %9.2f %7.2f  %016llx%s\n", res.name.c_str(),
+                   median > 0 ? perRom / median / 1e6 : 0.0, median * 1e9 / perRom,
+                   Variation(res.seconds), (unsigned long long)res.state, same ? "" : " MISMATCH");
+
+            if (json != NULL) {
+                fprintf(json, "%s\n        { \"name\": ", r == 0 ? "" : ",");
+                JsonString(json, res.name);
+                fprintf(json, ", \"ips\": %.0f, \"ns_per_instr\": %.4f, \"cv_percent\": %.3f, \"state\": \"%016llx\" }",
+                        median > 0 ? perRom / median : 0.0, median * 1e9 / perRom,
+                        Variation(res.seconds), (unsigned long long)res.state);
+            }
+        }
+
+        printf("  %-48s %10.1f %9.2f %7.2f\n", "TOTAL", total > 0 ? instrs / total / 1e6 : 0.0,
+               total * 1e9 / instrs, Variation(totals));
+        if (json != NULL) {
+            fprintf(json, "\n      ]\n    }");
+        }
+    }
+
+    if (json != NULL) {
+        fprintf(json, "\n  ],\n  \"state_mismatches\": %d\n}\n", mismatches);
+        fclose(json);
+    }
+
+    if (mismatches > 0) {
+        printf("\n%d ROM(s) ended in a different state than in the first mode\n", mismatches);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,169 @@
+/*
+ * chip8Decode.h
+ *  - Opcode decoder shared by the fast execution paths and the tools. Follows
+ *    the same opcode grouping as the switch in Chip8::EmulateCycle().
+ *    SUPER-CHIP / XO-CHIP opcodes decode only for an isa that has them
+ *    (Chip8Isa, chip8Quirks.h).
+ */
+
+#include "chip8Quirks.h"
+
+#ifndef __CHIP8DECODE__
+#define __CHIP8DECODE__
+
+enum Chip8Op {
+    OP_DECODE = 0,  // Not decoded yet (or invalidated by a write)
+    OP_CLS,         // 00E0
+    OP_RET,         // 00EE
+    OP_JP,          // 1NNN
+    OP_CALL,        // 2NNN
+    OP_SE_NN,       // 3XNN
+    OP_SNE_NN,      // 4XNN
+    OP_SE_VY,       // 5XY0
+    OP_LD_NN,       // 6XNN
+    OP_ADD_NN,      // 7XNN
+    OP_LD_VY,       // 8XY0
+    OP_OR,          // 8XY1
+    OP_AND,         // 8XY2
+    OP_XOR,         // 8XY3
+    OP_ADD_VY,      // 8XY4
+    OP_SUB,         // 8XY5
+    OP_SHR,         // 8XY6
+    OP_SUBN,        // 8XY7
+    OP_SHL,         // 8XYE
+    OP_SNE_VY,      // 9XY0
+    OP_LD_I,        // ANNN
+    OP_JP_V0,       // BNNN
+    OP_RND,         // CXNN
+    OP_DRW,         // DXYN
+    OP_SKP,         // EX9E
+    OP_SKNP,        // EXA1
+    OP_LD_VX_DT,    // FX07
+    OP_LD_VX_K,     // FX0A
+    OP_LD_DT_VX,    // FX15
+    OP_LD_ST_VX,    // FX18
+    OP_ADD_I,       // FX1E
+    OP_LD_F,        // FX29
+    OP_LD_B,        // FX33
+    OP_LD_MEM_VX,   // FX55
+    OP_LD_VX_MEM,   // FX65
+    OP_SCD,         // 00CN     SUPER-CHIP
+    OP_SCR,         // 00FB
+    OP_SCL,         // 00FC
+    OP_EXIT,        // 00FD
+    OP_LOW,         // 00FE
+    OP_HIGH,        // 00FF
+    OP_LD_HF,       // FX30
+    OP_LD_R_VX,     // FX75
+    OP_LD_VX_R,     // FX85
+    OP_SCU,         // 00DN     XO-CHIP
+    OP_SAVE_VY,     // 5XY2
+    OP_LOAD_VY,     // 5XY3
+    OP_LD_I_LONG,   // F000 NNNN
+    OP_PLANE,       // FN01
+    OP_AUDIO,       // F002
+    OP_PITCH,       // FX3A
+    OP_UNKNOWN,
+    OP_COUNT
+};
+
+struct Chip8Instr {
+    unsigned char  op;      // Chip8Op
+    unsigned char  x;       // Register X  (opcode & 0x0F00) >> 8
+    unsigned char  y;       // Register Y  (opcode & 0x00F0) >> 4
+    unsigned char  n;       // Nibble N    (opcode & 0x000F)
+    unsigned short nnn;     // Address NNN (opcode & 0x0FFF), NN is the low byte
+};
+
+inline Chip8Instr Chip8Decode(unsigned short opcode, int isa = CHIP8_ISA_CHIP8) {
+    Chip8Instr in;
+    in.op  = OP_UNKNOWN;
+    in.x   = (opcode & 0x0F00) >> 8;
+    in.y   = (opcode & 0x00F0) >> 4;
+    in.n   = opcode & 0x000F;
+    in.nnn = opcode & 0x0FFF;
+
+    switch (opcode & 0xF000) {
+        case 0x0000: {
+            if (isa >= CHIP8_ISA_SCHIP) {
+                if ((opcode & 0xFFF0) == 0x00C0 && in.n != 0)                   in.op = OP_SCD;
+                else if ((opcode & 0xFFF0) == 0x00D0 && isa >= CHIP8_ISA_XO)    in.op = OP_SCU;
+                else if (opcode == 0x00FB)  in.op = OP_SCR;
+                else if (opcode == 0x00FC)  in.op = OP_SCL;
+                else if (opcode == 0x00FD)  in.op = OP_EXIT;
+                else if (opcode == 0x00FE)  in.op = OP_LOW;
+                else if (opcode == 0x00FF)  in.op = OP_HIGH;
+                if (in.op != OP_UNKNOWN) {
+                    break;
+                }
+            }
+            if (in.n == 0x0)        in.op = OP_CLS;
+            else if (in.n == 0xE)   in.op = OP_RET;
+            break;
+        }
+        case 0x1000: in.op = OP_JP;      break;
+        case 0x2000: in.op = OP_CALL;    break;
+        case 0x3000: in.op = OP_SE_NN;   break;
+        case 0x4000: in.op = OP_SNE_NN;  break;
+        case 0x5000: {
+            in.op = OP_SE_VY;
+            if (isa >= CHIP8_ISA_XO) {
+                if (in.n == 0x2)        in.op = OP_SAVE_VY;
+                else if (in.n == 0x3)   in.op = OP_LOAD_VY;
+            }
+            break;
+        }
+        case 0x6000: in.op = OP_LD_NN;   break;
+        case 0x7000: in.op = OP_ADD_NN;  break;
+        case 0x8000: {
+            switch (in.n) {
+                case 0x0: in.op = OP_LD_VY;  break;
+                case 0x1: in.op = OP_OR;     break;
+                case 0x2: in.op = OP_AND;    break;
+                case 0x3: in.op = OP_XOR;    break;
+                case 0x4: in.op = OP_ADD_VY; break;
+                case 0x5: in.op = OP_SUB;    break;
+                case 0x6: in.op = OP_SHR;    break;
+                case 0x7: in.op = OP_SUBN;   break;
+                case 0xE: in.op = OP_SHL;    break;
+            }
+            break;
+        }
+        case 0x9000: in.op = OP_SNE_VY;  break;
+        case 0xA000: in.op = OP_LD_I;    break;
+        case 0xB000: in.op = OP_JP_V0;   break;
+        case 0xC000: in.op = OP_RND;     break;
+        case 0xD000: in.op = OP_DRW;     break;
+        case 0xE000: {
+            if ((opcode & 0x00FF) == 0x9E)      in.op = OP_SKP;
+            else if ((opcode & 0x00FF) == 0xA1) in.op = OP_SKNP;
+            break;
+        }
+        case 0xF000: {
+            switch (opcode & 0x00FF) {
+                case 0x07: in.op = OP_LD_VX_DT;  break;
+                case 0x0A: in.op = OP_LD_VX_K;   break;
+                case 0x15: in.op = OP_LD_DT_VX;  break;
+                case 0x18: in.op = OP_LD_ST_VX;  break;
+                case 0x1E: in.op = OP_ADD_I;     break;
+                case 0x29: in.op = OP_LD_F;      break;
+                case 0x33: in.op = OP_LD_B;      break;
+                case 0x55: in.op = OP_LD_MEM_VX; break;
+                case 0x65: in.op = OP_LD_VX_MEM; break;
+                case 0x30: if (isa >= CHIP8_ISA_SCHIP) in.op = OP_LD_HF;   break;
+                case 0x75: if (isa >= CHIP8_ISA_SCHIP) in.op = OP_LD_R_VX; break;
+                case 0x85: if (isa >= CHIP8_ISA_SCHIP) in.op = OP_LD_VX_R; break;
+                case 0x3A: if (isa >= CHIP8_ISA_XO)    in.op = OP_PITCH;   break;
+            }
+            if (isa >= CHIP8_ISA_XO) {
+                if (opcode == 0xF000)                   in.op = OP_LD_I_LONG;
+                else if (opcode == 0xF002)              in.op = OP_AUDIO;
+                else if ((opcode & 0x00FF) == 0x01)     in.op = OP_PLANE;
+            }
+            break;
+        }
+    }
+    return in;
+}
+
+#endif
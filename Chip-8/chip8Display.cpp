@@ -0,0 +1,187 @@
+/*
+ * chip8Display.cpp
+ *  - SUPER-CHIP / XO-CHIP display operations. Everything works on whole
+ *    packed rows: a hi-res row is the 128 bit value half 0 : half 1, so
+ *    sprites are placed with one shift (and one rotate when wrapping),
+ *    horizontal scrolls shift every row by 4 and vertical scrolls move rows
+ *    with memmove. No pixel is touched on its own, hi-res costs about the
+ *    same per sprite row or scroll as lo-res.
+ *
+ *    Scroll distances are in pixels of the current resolution (as in Octo,
+ *    not the half pixels SUPER-CHIP 1.1 scrolls in lo-res). Switching the
+ *    resolution clears the screen.
+ */
+
+#include "chip8.h"
+
+typedef unsigned __int128 Chip8Row;     // Hi-res row, bit 127 = leftmost pixel
+
+static inline Chip8Row Rotr(Chip8Row v, unsigned int n) {
+    return n == 0 ? v : (v >> n) | (v << (128 - n));
+}
+
+unsigned char Chip8::DrawExtended(unsigned short x, unsigned short y, unsigned short height, unsigned short addr,
+                                  bool wrap, unsigned int addrMask) {
+    const int width = Width();
+    const int rows  = Height();
+    const bool wide = (height == 0);    // DXY0: 16x16, two bytes per row
+    const int lines = wide ? 16 : height;
+    uint64_t collision = 0;
+
+    // The start position always wraps, the sprite itself wraps or clips
+    x %= width;
+    y %= rows;
+    for (int p = 0; p < CHIP8_PLANES; ++p) {
+        if (!(planes & (1 << p))) {
+            continue;
+        }
+        uint64_t * half0 = gfx[p][0];
+        uint64_t * half1 = gfx[p][1];
+
+        // Each selected plane takes the next sprite worth of data
+        for (int yline = 0; yline < lines; yline++) {
+            int row = y + yline;
+            if (row >= rows) {
+                if (!wrap) {
+                    break;
+                }
+                row -= rows;
+            }
+
+            unsigned int data = memory[(addr + yline * (wide ? 2 : 1)) & addrMask];
+            if (wide) {
+                data = (data << 8) | memory[(addr + yline * 2 + 1) & addrMask];
+            }
+
+            if (hires) {
+                Chip8Row bits = (Chip8Row)data << (wide ? 112 : 120);
+                Chip8Row line = wrap ? Rotr(bits, x) : (bits >> x);
+                uint64_t hi = (uint64_t)(line >> 64);
+                uint64_t lo = (uint64_t)line;
+                collision |= (half0[row] & hi) | (half1[row] & lo);
+                half0[row] ^= hi;
+                half1[row] ^= lo;
+            } else {
+                uint64_t bits = (uint64_t)data << (wide ? 48 : 56);
+                uint64_t line = wrap ? ((bits >> x) | (bits << ((64 - x) & 63))) : (bits >> x);
+                collision |= half0[row] & line;
+                half0[row] ^= line;
+            }
+        }
+        addr += lines * (wide ? 2 : 1);
+    }
+
+    return collision != 0;
+}
+
+void Chip8::ClearScreen() {
+    for (int p = 0; p < CHIP8_PLANES; ++p) {
+        if (!(planes & (1 << p))) {
+            continue;
+        }
+        if (hires) {
+            memset(gfx[p], 0x00, sizeof(gfx[p]));
+        } else {
+            memset(gfx[p][0], 0x00, 32 * sizeof(uint64_t));
+        }
+    }
+    drawFlag = true;
+}
+
+// 00CN
+void Chip8::ScrollDown(int n) {
+    const int rows   = Height();
+    const int halves = hires ? 2 : 1;
+    if (n > rows) {
+        n = rows;
+    }
+    for (int p = 0; p < CHIP8_PLANES; ++p) {
+        if (!(planes & (1 << p))) {
+            continue;
+        }
+        for (int h = 0; h < halves; ++h) {
+            memmove(&gfx[p][h][n], &gfx[p][h][0], (rows - n) * sizeof(uint64_t));
+            memset(&gfx[p][h][0], 0x00, n * sizeof(uint64_t));
+        }
+    }
+    drawFlag = true;
+}
+
+// 00DN
+void Chip8::ScrollUp(int n) {
+    const int rows   = Height();
+    const int halves = hires ? 2 : 1;
+    if (n > rows) {
+        n = rows;
+    }
+    for (int p = 0; p < CHIP8_PLANES; ++p) {
+        if (!(planes & (1 << p))) {
+            continue;
+        }
+        for (int h = 0; h < halves; ++h) {
+            memmove(&gfx[p][h][0], &gfx[p][h][n], (rows - n) * sizeof(uint64_t));
+            memset(&gfx[p][h][rows - n], 0x00, n * sizeof(uint64_t));
+        }
+    }
+    drawFlag = true;
+}
+
+// 00FB, 4 pixels
+void Chip8::ScrollRight() {
+    for (int p = 0; p < CHIP8_PLANES; ++p) {
+        if (!(planes & (1 << p))) {
+            continue;
+        }
+        uint64_t * half0 = gfx[p][0];
+        uint64_t * half1 = gfx[p][1];
+        if (hires) {
+            for (int row = 0; row < 64; ++row) {
+                half1[row] = (half1[row] >> 4) | (half0[row] << 60);
+                half0[row] >>= 4;
+            }
+        } else {
+            for (int row = 0; row < 32; ++row) {
+                half0[row] >>= 4;
+            }
+        }
+    }
+    drawFlag = true;
+}
+
+// 00FC, 4 pixels
+void Chip8::ScrollLeft() {
+    for (int p = 0; p < CHIP8_PLANES; ++p) {
+        if (!(planes & (1 << p))) {
+            continue;
+        }
+        uint64_t * half0 = gfx[p][0];
+        uint64_t * half1 = gfx[p][1];
+        if (hires) {
+            for (int row = 0; row < 64; ++row) {
+                half0[row] = (half0[row] << 4) | (half1[row] >> 60);
+                half1[row] <<= 4;
+            }
+        } else {
+            for (int row = 0; row < 32; ++row) {
+                half0[row] <<= 4;
+            }
+        }
+    }
+    drawFlag = true;
+}
+
+// 00FE / 00FF, clears every plane
+void Chip8::SetHires(bool enable) {
+    hires = enable;
+    memset(gfx, 0x00, sizeof(gfx));
+    drawFlag = true;
+}
+
+void Chip8::UnpackFramebuffer(unsigned char * out) const {
+    const int width = Width();
+    for (int y = 0; y < Height(); y++) {
+        for (int x = 0; x < width; x++) {
+            out[(y * width) + x] = GetPixel(x, y);
+        }
+    }
+}
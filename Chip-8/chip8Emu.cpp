@@ -5,41 +5,159 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <atomic>
+#include <thread>
 #include <GL/glut.h>
 #include "chip8.h"
-#include <unistd.h>
+#include "chip8Audio.h"
+#include "chip8Frame.h"
+#include "chip8Render.h"
+#include "chip8Scheduler.h"
+#include "chip8Rewind.h"
+#include "chip8Input.h"
+#include "chip8Rom.h"
 
 // Display size
 #define SCREEN_WIDTH  64
 #define SCREEN_HEIGHT 32
 
+// Unlimited speed: instructions run between deadline checks
+#define UNLIMITED_CHUNK 4096
+
+// Rewind history (hold backspace)
+#define REWIND_SECONDS  60
+
+// Display thread poll interval while no new frame is ready
+#define IDLE_SLEEP_NS   1000000
+
+// Effective speed is measured over this many seconds of real time
+#define SPEED_WINDOW    0.5
+
+// Emulation runs on its own thread (emulate()) and owns the machine, the
+// scheduler and the rewind buffer. The GLUT thread only talks to it through
+// the atomics below and picks up finished frames from the triple buffer.
 Chip8 myChip8;
+Chip8Scheduler scheduler;
+Chip8Rewind rewindBuffer(REWIND_SECONDS * TIMER_HZ);
+std::thread emuThread;
+
+Chip8FrameBuffer frames;
+std::atomic<unsigned short> keyState(0);   // Bit n = key n down
+std::atomic<bool> rewinding(false);
+std::atomic<bool> running(true);
+
+// Turbo (tab or -turbo): emulated frames back to back, as fast as the host
+// goes, one published frame per display frame
+std::atomic<bool> turbo(false);
+std::atomic<unsigned int> speed(10);        // Emulated / real time, in tenths
+
+// Requests from the GLUT thread, handled between two frames
+enum EmuCommand { CMD_NONE, CMD_SAVE, CMD_LOAD };
+std::atomic<int> command(CMD_NONE);
+
+// Quick save slot (F5 save, F9 load)
+char stateFile[4096];
+
+// Input recording (-record), replayable with chip8-replay
+Chip8InputLog inputLog;
+const char * recordFile = NULL;
+
+// Sound (-wav), mixed on its own thread in emulated time
+Chip8WavSink * wavSink = NULL;
+Chip8Audio * audio = NULL;
 
 // Define the display Window
 int modifier = 10;
 int display_width  = SCREEN_WIDTH  * modifier;
 int display_height = SCREEN_HEIGHT * modifier;
-unsigned char screenData[SCREEN_HEIGHT][SCREEN_WIDTH][3]; 
+
+Chip8Renderer renderer;
+bool forcePresent = true;       // Window contents need a redraw
+
+// Emulation thread
+void emulate();
 
 // Window Functions
+void idle();
 void display();
 void reshape_window(GLsizei w, GLsizei h);
 
 // IO
 void keyboardUp  (unsigned char key, int x, int y);
 void keyboardDown(unsigned char key, int x, int y);
+void specialDown (int key, int x, int y);
+void quit();
 
 int main(int argc, char **argv) {		
     
-    if(argc < 2) {
-        printf("Usage: chip8Emu chip8application\n\n");
+    const char * application = NULL;
+    const char * quirks = "auto";
+    for(int i = 1; i < argc; ++i) {
+        if(strcmp(argv[i], "-hz") == 0 && i + 1 < argc) {
+            scheduler.SetFrequency(strtoul(argv[++i], NULL, 10));
+        } else if(strcmp(argv[i], "-seed") == 0 && i + 1 < argc) {
+            myChip8.Seed(strtoull(argv[++i], NULL, 10));
+        } else if(strcmp(argv[i], "-record") == 0 && i + 1 < argc) {
+            recordFile = argv[++i];
+        } else if(strcmp(argv[i], "-quirks") == 0 && i + 1 < argc) {
+            quirks = argv[++i];
+        } else if(strcmp(argv[i], "-wav") == 0 && i + 1 < argc) {
+            wavSink = new Chip8WavSink(argv[++i]);
+        } else if(strcmp(argv[i], "-turbo") == 0) {
+            turbo.store(true);
+        } else {
+            application = argv[i];
+        }
+    }
+
+    if(application == NULL) {
+        printf("Usage: chip8Emu [-hz cpu_hz] [-seed n] [-quirks profile] [-record file] [-wav file] [-turbo] chip8application\n");
+        printf("  -hz      instructions per second, 0 = unlimited (default %d)\n", CHIP8_DEFAULT_HZ);
+        printf("  -seed    random number seed (default: time based)\n");
+        printf("  -quirks  chip8 | vip | schip | xo | auto (default auto: picked for the ROM)\n");
+        printf("  -record  write an input log for chip8-replay\n");
+        printf("  -wav     write the sound to a .wav file\n");
+        printf("  -turbo   start in fast forward (tab toggles)\n\n");
         return 1;
     }
 
     // Load game
-    if(!myChip8.LoadApplication((const char *)argv[1])) {	
+    std::vector<unsigned char> rom;
+    Chip8Quirks profile = CHIP8_QUIRKS_CHIP8;
+    if(strcmp(quirks, "auto") == 0) {
+        if(ReadRomFile(application, rom))
+            profile = DetectQuirks(rom);
+    } else if(!Chip8QuirksFromName(quirks, profile)) {
+        printf("Error: unknown quirks profile %s\n", quirks);
+        return 1;
+    }
+    myChip8.SetQuirks(profile);
+    if(!myChip8.LoadApplication(application)) {	
         return 1;
     }
+
+    // A replay rebuilds frames from the cycle count, so the recorded
+    // session must run at a fixed rate and never jump in time
+    if(recordFile != NULL) {
+        if(scheduler.Unlimited() || (rom.empty() && !ReadRomFile(application, rom))) {
+            printf("Error: recording needs a fixed -hz\n");
+            return 1;
+        }
+        inputLog.Begin(myChip8, rom.empty() ? NULL : &rom[0], (long)rom.size(), scheduler.GetFrequency());
+    }
+    snprintf(stateFile, sizeof(stateFile), "%s.state", application);
+
+    if(wavSink != NULL) {
+        audio = new Chip8Audio(wavSink);
+        if(!audio->Start()) {
+            printf("Error: unable to write the sound file\n");
+            return 1;
+        }
+        myChip8.AttachAudio(audio);
+    }
 		
     // Setup OpenGL
     glutInit(&argc, argv);          
@@ -50,57 +168,151 @@ int main(int argc, char **argv) {
     glutCreateWindow("Chip-8 Emu");
 
     glutDisplayFunc(display);
-    glutIdleFunc(display);
+    glutIdleFunc(idle);
     glutReshapeFunc(reshape_window);            
     glutKeyboardFunc(keyboardDown);
     glutKeyboardUpFunc(keyboardUp); 
+    glutSpecialFunc(specialDown);
+
+    renderer.Init();
+    emuThread = std::thread(emulate);
 
     glutMainLoop(); 
 
     return 0;
 }
 
-void drawPixel(int x, int y) {
-    glBegin(GL_QUADS);
-        glVertex3f((x * modifier) + 0.0f,     (y * modifier) + 0.0f,	 0.0f);
-        glVertex3f((x * modifier) + 0.0f,     (y * modifier) + modifier, 0.0f);
-        glVertex3f((x * modifier) + modifier, (y * modifier) + modifier, 0.0f);
-        glVertex3f((x * modifier) + modifier, (y * modifier) + 0.0f,	 0.0f);
-    glEnd();
+double seconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
 }
 
-void updateQuads(const Chip8& c8) {
-    for(int y = 0; y < 32; y++) {	
-        for(int x = 0; x < 64; x++) {
-            if(c8.gfx[(y*64) + x] == 0) {
-                glColor3f(0.0f,0.0f,0.0f);
-            } else {
-                glColor3f(1.0f,1.0f,1.0f);
+// Emulation thread. Every 1/60 s frame: a batch of instructions, one timer
+// tick, at most one published frame, then sleep until the frame deadline.
+// In turbo the batch is as many whole emulated frames as fit before the
+// deadline.
+void emulate() {
+    bool publish = true;        // Screen changed without a draw (rewind, load)
+
+    unsigned long emulated = 0; // Emulated frames since speedStart
+    double speedStart = seconds();
+
+    scheduler.StartClock();
+    while(running.load(std::memory_order_acquire)) {
+
+        int cmd = command.exchange(CMD_NONE, std::memory_order_acquire);
+        if(cmd == CMD_SAVE) {
+            if(myChip8.SaveState(stateFile))
+                printf("Saved %s\n", stateFile);
+        } else if(cmd == CMD_LOAD) {
+            if(myChip8.LoadState(stateFile)) {
+                printf("Loaded %s\n", stateFile);
+                rewindBuffer.Clear();
+                publish = true;
+            }
+        }
+
+        myChip8.SetKeys(keyState.load(std::memory_order_relaxed));
+
+        bool rewind = rewinding.load(std::memory_order_relaxed);
+        if(rewind) {
+            // One frame back per frame, time runs backwards at normal speed
+            if(rewindBuffer.StepBack(myChip8)) {
+                publish = true;
             }
-            drawPixel(x, y);
+        } else if(turbo.load(std::memory_order_relaxed)) {
+            // Draws of all but the last of these frames are dropped, and
+            // rewind keeps one snapshot per displayed frame
+            do {
+                if(recordFile != NULL) {
+                    inputLog.Record(myChip8);
+                }
+                myChip8.RunFrame(scheduler.Unlimited() ? UNLIMITED_CHUNK : scheduler.NextFrameCycles());
+                emulated++;
+            } while(!scheduler.DeadlineReached());
+        } else if(scheduler.Unlimited()) {
+            // As many instructions as fit in the frame, nothing more to do
+            // once the ROM waits for the timer or a key
+            do {
+                myChip8.Run(UNLIMITED_CHUNK);
+            } while(!myChip8.Idle() && !scheduler.DeadlineReached());
+            myChip8.TickTimers();
+            emulated++;
+        } else {
+            if(recordFile != NULL) {
+                inputLog.Record(myChip8);
+            }
+            myChip8.RunFrame(scheduler.NextFrameCycles());
+            emulated++;
+        }
+        if(!rewind) {
+            rewindBuffer.Push(myChip8);
         }
+
+        // Frames drawn during the batch are folded into one
+        if(myChip8.drawFlag || publish) {
+            Chip8Frame & out = frames.Back();
+            memcpy(out.gfx, myChip8.gfx, sizeof(out.gfx));
+            out.hires = myChip8.HiRes();
+            out.cycle = myChip8.GetCycles();
+            frames.Publish();
+
+            myChip8.drawFlag = false;
+            publish = false;
+        }
+
+        double now = seconds();
+        if(now - speedStart >= SPEED_WINDOW) {
+            speed.store((unsigned int)(emulated * 10.0 / TIMER_HZ / (now - speedStart) + 0.5), std::memory_order_relaxed);
+            emulated = 0;
+            speedStart = now;
+        }
+
+        scheduler.WaitNextFrame();
     }
 }
 
-void display() {
-    
-    myChip8.EmulateCycle();
-		
-    if(myChip8.drawFlag) {
-        
-        // Clear framebuffer
-        glClear(GL_COLOR_BUFFER_BIT);
-        updateQuads(myChip8);		
+// Window title with the effective speed while in turbo
+void updateTitle() {
+    static unsigned int shown = 0;          // 0 = plain title
+
+    unsigned int tenths = turbo.load(std::memory_order_relaxed) ? speed.load(std::memory_order_relaxed) : 0;
+    if(tenths == shown)
+        return;
+
+    char title[64];
+    if(tenths == 0)
+        snprintf(title, sizeof(title), "Chip-8 Emu");
+    else if(tenths < 100)
+        snprintf(title, sizeof(title), "Chip-8 Emu - turbo %u.%ux", tenths / 10, tenths % 10);
+    else
+        snprintf(title, sizeof(title), "Chip-8 Emu - turbo %ux", (tenths + 5) / 10);
+    glutSetWindowTitle(title);
+    shown = tenths;
+}
 
-        // Swap buffers!
-        glutSwapBuffers();    
+// GLUT thread: present the last published frame, at most once per frame
+// (vsync paces the swap), and stay off the CPU while nothing changes.
+void idle() {
+    updateTitle();
 
-        // Processed frame
-        myChip8.drawFlag = false;
+    if(frames.Acquire() || forcePresent) {
+        display();
+    } else {
+        struct timespec pause = { 0, IDLE_SLEEP_NS };
+        nanosleep(&pause, NULL);
     }
-    
-    // Throttle
-    usleep(160);     // 1000ms / 16 = 16.666667ms
+}
+
+void display() {
+    renderer.Update(frames.Front().gfx, frames.Front().hires);
+    renderer.Draw(display_width, display_height);
+
+    // Swap buffers!
+    glutSwapBuffers();    
+
+    forcePresent = false;
 }
 
 void reshape_window(GLsizei w, GLsizei h) {
@@ -114,52 +326,71 @@ void reshape_window(GLsizei w, GLsizei h) {
     // Resize quad
     display_width = w;
     display_height = h;
+    forcePresent = true;
+}
+
+// Hex keypad on the left of the keyboard
+//   1 2 3 C      1 2 3 4
+//   4 5 6 D      q w e r
+//   7 8 9 E      a s d f
+//   A 0 B F      z x c v
+int keypad(unsigned char key) {
+    switch(key) {
+        case '1': return 0x1;   case '2': return 0x2;   case '3': return 0x3;   case '4': return 0xC;
+        case 'q': return 0x4;   case 'w': return 0x5;   case 'e': return 0x6;   case 'r': return 0xD;
+        case 'a': return 0x7;   case 's': return 0x8;   case 'd': return 0x9;   case 'f': return 0xE;
+        case 'z': return 0xA;   case 'x': return 0x0;   case 'c': return 0xB;   case 'v': return 0xF;
+    }
+    return -1;
 }
 
 void keyboardDown(unsigned char key, int x, int y) {
     if(key == 27)    // esc
-        exit(0);
-
-    if(key == '1')		myChip8.key[0x1] = 1;
-    else if(key == '2')	myChip8.key[0x2] = 1;
-    else if(key == '3')	myChip8.key[0x3] = 1;
-    else if(key == '4')	myChip8.key[0xC] = 1;
-
-    else if(key == 'q')	myChip8.key[0x4] = 1;
-    else if(key == 'w')	myChip8.key[0x5] = 1;
-    else if(key == 'e')	myChip8.key[0x6] = 1;
-    else if(key == 'r')	myChip8.key[0xD] = 1;
-
-    else if(key == 'a')	myChip8.key[0x7] = 1;
-    else if(key == 's')	myChip8.key[0x8] = 1;
-    else if(key == 'd')	myChip8.key[0x9] = 1;
-    else if(key == 'f')	myChip8.key[0xE] = 1;
-
-    else if(key == 'z')	myChip8.key[0xA] = 1;
-    else if(key == 'x')	myChip8.key[0x0] = 1;
-    else if(key == 'c')	myChip8.key[0xB] = 1;
-    else if(key == 'v')	myChip8.key[0xF] = 1;
+        quit();
+
+    if(key == 8 && recordFile == NULL)     // backspace
+        rewinding.store(true, std::memory_order_relaxed);
+
+    if(key == 9)     // tab
+        turbo.store(!turbo.load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+    int k = keypad(key);
+    if(k >= 0)
+        keyState.fetch_or((unsigned short)(1 << k), std::memory_order_relaxed);
 }
 
 void keyboardUp(unsigned char key, int x, int y)
 {    
-    if(key == '1')		myChip8.key[0x1] = 0;
-    else if(key == '2')	myChip8.key[0x2] = 0;
-    else if(key == '3')	myChip8.key[0x3] = 0;
-    else if(key == '4')	myChip8.key[0xC] = 0;
-
-    else if(key == 'q')	myChip8.key[0x4] = 0;
-    else if(key == 'w')	myChip8.key[0x5] = 0;
-    else if(key == 'e')	myChip8.key[0x6] = 0;
-    else if(key == 'r')	myChip8.key[0xD] = 0;
-
-    else if(key == 'a')	myChip8.key[0x7] = 0;
-    else if(key == 's')	myChip8.key[0x8] = 0;
-    else if(key == 'd')	myChip8.key[0x9] = 0;
-    else if(key == 'f')	myChip8.key[0xE] = 0;
-
-    else if(key == 'z')	myChip8.key[0xA] = 0;
-    else if(key == 'x')	myChip8.key[0x0] = 0;
-    else if(key == 'c')	myChip8.key[0xB] = 0;
-    else if(key == 'v')	myChip8.key[0xF] = 0;
+    if(key == 8)
+        rewinding.store(false, std::memory_order_relaxed);
+
+    int k = keypad(key);
+    if(k >= 0)
+        keyState.fetch_and((unsigned short)~(1 << k), std::memory_order_relaxed);
+}
+
+void specialDown(int key, int x, int y) {
+    if(key == GLUT_KEY_F5)
+        command.store(CMD_SAVE, std::memory_order_release);
+    else if(key == GLUT_KEY_F9 && recordFile == NULL)
+        command.store(CMD_LOAD, std::memory_order_release);
+}
+
+void quit() {
+    running.store(false, std::memory_order_release);
+    if(emuThread.joinable())
+        emuThread.join();
+
+    if(audio != NULL)
+        audio->Finish();
+
+    if(recordFile != NULL) {
+        inputLog.End(myChip8);
+        if(inputLog.Save(recordFile))
+            printf("Recorded %s: %llu cycles, %zu input events\n", recordFile,
+                   (unsigned long long)inputLog.GetEndCycle(), inputLog.GetEventCount());
+        else
+            printf("Error: unable to write %s\n", recordFile);
+    }
+    exit(0);
 }
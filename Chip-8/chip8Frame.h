@@ -0,0 +1,60 @@
+/*
+ * chip8Frame.h
+ *  - Lock-free triple buffer handing finished frames from the emulation
+ *    thread to the display thread. The writer fills its back slot and
+ *    publishes it by swapping it with the middle slot; the reader swaps the
+ *    middle slot with its front slot when a new frame is there. Neither
+ *    side ever waits: the writer overwrites frames the reader didn't pick
+ *    up, the reader keeps showing its front slot until a new one arrives.
+ *
+ *    One writer thread and one reader thread.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+
+#ifndef __CHIP8FRAME__
+#define __CHIP8FRAME__
+
+struct alignas(64) Chip8Frame {
+    uint64_t gfx[2][2][64];     // Chip8::gfx, [plane][half][row], bit 63 = leftmost pixel
+    bool     hires;             // 128x64, else 64x32 in rows 0-31 of half 0
+    uint64_t cycle;             // Chip8::GetCycles() when published
+};
+
+class Chip8FrameBuffer {
+
+    public:
+
+        Chip8FrameBuffer() : back(0), front(1), middle(2) {
+            memset(slots, 0x00, sizeof(slots));
+        }
+
+        // Writer
+        Chip8Frame & Back() { return slots[back]; }
+        void Publish() {
+            back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & SLOT;
+        }
+
+        // Reader, true if Front() changed
+        bool Acquire() {
+            if ((middle.load(std::memory_order_relaxed) & FRESH) == 0) {
+                return false;
+            }
+            front = middle.exchange(front, std::memory_order_acq_rel) & SLOT;
+            return true;
+        }
+        const Chip8Frame & Front() const { return slots[front]; }
+
+    private:
+
+        enum { SLOT = 0x3, FRESH = 0x4 };
+
+        Chip8Frame                slots[3];
+        unsigned int              back;         // Writer only
+        unsigned int              front;        // Reader only
+        std::atomic<unsigned int> middle;       // Slot index | FRESH
+};
+
+#endif
@@ -0,0 +1,185 @@
+/*
+ * chip8Idle.cpp
+ *  - Wait loop detection. Inside one Run() the timers don't tick, the keys
+ *    don't change and memory only changes through FX33/FX55, so a loop that
+ *    touches nothing but V, I and pc is a pure function of those registers.
+ *    ROMs waiting on the delay timer (FX07 / 3X00 / 1NNN) or on a key
+ *    (FX0A) run such loops. Once one iteration ends in the register state it
+ *    started from, every further iteration repeats it, and the state after
+ *    any number of cycles can be read off a recorded iteration instead of
+ *    executing it.
+ *
+ *    SkipIdle() simulates two iterations from the current pc on a copy of
+ *    the registers. If the second one is a fixed point it jumps straight to
+ *    the state at the end of the budget, which is exactly where stepping
+ *    would have ended.
+ */
+
+#include "chip8.h"
+
+#define IDLE_MAX_LOOP  16       // Longest loop body recognized, in instructions
+
+struct Chip8IdleRegs {
+    unsigned char  V[16];
+    unsigned short I;
+    unsigned short pc;
+
+    bool operator==(const Chip8IdleRegs & o) const {
+        return I == o.I && pc == o.pc && memcmp(V, o.V, sizeof(V)) == 0;
+    }
+};
+
+// One instruction on the registers only, same as Chip8::Step() with the
+// given quirks. Returns false for instructions with any other effect
+// (stack, screen, memory, timers, RNG), which end the search.
+bool Chip8::IdleStep(Chip8IdleRegs & r, const Chip8QuirkFlags & q) const {
+    unsigned short addr = r.pc & 0x0FFF;
+    Chip8Instr in = Chip8Decode((memory[addr] << 8) | memory[(addr + 1) & 0x0FFF], q.isa);
+    unsigned short p = r.pc;
+    unsigned int mask = (q.isa == CHIP8_ISA_XO) ? 0xFFFF : 0x0FFF;
+
+    // Taken skips jump over F000 NNNN whole under XO-CHIP
+    unsigned short skip = 2;
+    if (q.isa == CHIP8_ISA_XO && memory[(addr + 2) & 0x0FFF] == 0xF0 && memory[(addr + 3) & 0x0FFF] == 0x00) {
+        skip = 4;
+    }
+
+    switch (in.op) {
+        case OP_JP:         p = in.nnn - OPCODE_LEN;                        break;
+        case OP_JP_V0:      p = in.nnn + r.V[q.jumpVx ? in.x : 0] - OPCODE_LEN; break;
+        case OP_SE_NN:      if (r.V[in.x] == (in.nnn & 0xFF)) p += skip;       break;
+        case OP_SNE_NN:     if (r.V[in.x] != (in.nnn & 0xFF)) p += skip;       break;
+        case OP_SE_VY:      if (r.V[in.x] == r.V[in.y]) p += skip;             break;
+        case OP_SNE_VY:     if (r.V[in.x] != r.V[in.y]) p += skip;             break;
+        case OP_LD_NN:      r.V[in.x] = in.nnn & 0xFF;                      break;
+        case OP_ADD_NN:     r.V[in.x] += in.nnn & 0xFF;                     break;
+        case OP_LD_VY:      r.V[in.x] = r.V[in.y];                          break;
+        case OP_OR:
+        case OP_AND:
+        case OP_XOR:
+            if (in.op == OP_OR) {
+                r.V[in.x] |= r.V[in.y];
+            } else if (in.op == OP_AND) {
+                r.V[in.x] &= r.V[in.y];
+            } else {
+                r.V[in.x] ^= r.V[in.y];
+            }
+            if (q.logicVf) {
+                r.V[0xF] = 0;
+            }
+            break;
+        case OP_ADD_VY:
+            r.V[0xF] = r.V[in.y] > (0xFF - r.V[in.x]);
+            r.V[in.x] += r.V[in.y];
+            break;
+        case OP_SUB:
+            r.V[0xF] = r.V[in.y] <= r.V[in.x];
+            r.V[in.x] -= r.V[in.y];
+            break;
+        case OP_SHR:
+            if (q.shiftVy) {
+                r.V[in.x] = r.V[in.y];
+            }
+            r.V[0xF] = r.V[in.x] & 0x01;
+            r.V[in.x] >>= 1;
+            break;
+        case OP_SUBN:
+            r.V[0xF] = r.V[in.y] >= r.V[in.x];
+            r.V[in.x] = r.V[in.y] - r.V[in.x];
+            break;
+        case OP_SHL:
+            if (q.shiftVy) {
+                r.V[in.x] = r.V[in.y];
+            }
+            r.V[0xF] = r.V[in.x] >> 7;
+            r.V[in.x] <<= 1;
+            break;
+        case OP_LD_I:       r.I = in.nnn;                                   break;
+        case OP_SKP:        if (key[r.V[in.x] & 0x0F] != 0) p += skip;         break;
+        case OP_SKNP:       if (key[r.V[in.x] & 0x0F] == 0) p += skip;         break;
+        case OP_LD_VX_DT:   r.V[in.x] = timer_delay;                        break;
+        case OP_LD_VX_K: {
+            bool keyPress = false;
+            for (int i = 0; i < 16; ++i) {
+                if (key[i] != 0) {
+                    r.V[in.x] = i;
+                    keyPress = true;
+                }
+            }
+            if (!keyPress) {
+                return true;        // pc stays
+            }
+            break;
+        }
+        case OP_ADD_I:
+            if (q.isa != CHIP8_ISA_XO) {
+                r.V[0xF] = (r.I + r.V[in.x] > 0x0FFF) ? 1 : 0;
+            }
+            r.I += r.V[in.x];
+            break;
+        case OP_LD_F:       r.I = r.V[in.x] * 0x5;                          break;
+        case OP_LD_VX_MEM: {
+            for (int i = 0; i <= in.x; ++i) {
+                r.V[i] = memory[(r.I + i) & mask];
+            }
+            if (q.memIncI) {
+                r.I += in.x + 1;
+            }
+            break;
+        }
+        case OP_LD_HF:      r.I = CHIP8_BIGFONT + (r.V[in.x] & 0x0F) * 10;  break;
+        case OP_LD_I_LONG:
+            r.I = (memory[(addr + 2) & 0x0FFF] << 8) | memory[(addr + 3) & 0x0FFF];
+            p += 2;
+            break;
+        case OP_EXIT:
+            return true;            // pc stays
+        default:
+            return false;
+    }
+
+    r.pc = (p + OPCODE_LEN) & 0x0FFF;
+    return true;
+}
+
+bool Chip8::SkipIdle(unsigned long cycles) {
+    const Chip8QuirkFlags & q = Chip8GetQuirkFlags(quirks);
+    Chip8IdleRegs start;
+    memcpy(start.V, V, sizeof(start.V));
+    start.I  = I;
+    start.pc = pc;
+
+    // First iteration, back to the starting pc
+    Chip8IdleRegs r = start;
+    unsigned long first = 0;
+    do {
+        if (++first > IDLE_MAX_LOOP || !IdleStep(r, q)) {
+            return false;
+        }
+    } while (r.pc != start.pc);
+
+    // Second iteration, recorded
+    Chip8IdleRegs loop[IDLE_MAX_LOOP];
+    unsigned long length = 0;
+    const Chip8IdleRegs head = r;
+    do {
+        if (length == IDLE_MAX_LOOP) {
+            return false;
+        }
+        loop[length++] = r;
+        if (!IdleStep(r, q)) {
+            return false;
+        }
+    } while (r.pc != start.pc);
+
+    if (!(r == head) || cycles < first) {
+        return false;
+    }
+
+    // From head on every iteration is the same
+    const Chip8IdleRegs & end = loop[(cycles - first) % length];
+    memcpy(V, end.V, sizeof(V));
+    I  = end.I;
+    pc = end.pc;
+    return true;
+}
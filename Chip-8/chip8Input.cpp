@@ -0,0 +1,188 @@
+/*
+ * chip8Input.cpp
+ *  - Log file, little endian:
+ *
+ *      "C8IN"  magic
+ *      u16     version (CHIP8_INPUT_VERSION)
+ *      u16     quirks profile (Chip8Quirks, not in version 1)
+ *      u32     hz
+ *      u64     seed, ROM hash (FNV-1a), end cycle
+ *      u32     event count
+ *      events  u64 cycle, u16 keys
+ */
+
+#include "chip8Input.h"
+#include "chip8Scheduler.h"
+
+#define INPUT_MAGIC       "C8IN"
+#define INPUT_HEADER_SIZE (4 + 2 + 2 + 4 + 24 + 4)
+#define INPUT_EVENT_SIZE  (8 + 2)
+
+Chip8InputLog::Chip8InputLog() : seed(0), hz(CHIP8_DEFAULT_HZ), quirks(CHIP8_QUIRKS_CHIP8), romHash(0), endCycle(0), lastKeys(0) {
+}
+
+uint64_t Chip8InputLog::HashRom(const unsigned char * rom, long size) {
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (long i = 0; i < size; ++i) {
+        hash = (hash ^ rom[i]) * 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+void Chip8InputLog::Begin(const Chip8 & c8, const unsigned char * rom, long size, unsigned long hz) {
+    this->hz = hz;
+    seed     = c8.GetSeed();
+    quirks   = c8.GetQuirks();
+    romHash  = HashRom(rom, size);
+    endCycle = c8.GetCycles();
+    lastKeys = 0;               // key[] is clear after a load
+    events.clear();
+    Record(c8);
+}
+
+void Chip8InputLog::Record(const Chip8 & c8) {
+    unsigned short keys = c8.GetKeys();
+    if (keys != lastKeys) {
+        Chip8InputEvent event;
+        event.cycle = c8.GetCycles();
+        event.keys  = keys;
+        events.push_back(event);
+        lastKeys = keys;
+    }
+}
+
+void Chip8InputLog::End(const Chip8 & c8) {
+    endCycle = c8.GetCycles();
+}
+
+static void Put(std::vector<unsigned char> & out, uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; ++i) {
+        out.push_back((v >> (i * 8)) & 0xFF);
+    }
+}
+
+static uint64_t Get(const unsigned char * & p, int bytes) {
+    uint64_t v = 0;
+    for (int i = 0; i < bytes; ++i) {
+        v |= (uint64_t)*p++ << (i * 8);
+    }
+    return v;
+}
+
+bool Chip8InputLog::Save(const char * filename) const {
+    std::vector<unsigned char> data;
+    data.reserve(INPUT_HEADER_SIZE + events.size() * INPUT_EVENT_SIZE);
+    for (int i = 0; i < 4; ++i) {
+        data.push_back(INPUT_MAGIC[i]);
+    }
+    Put(data, CHIP8_INPUT_VERSION, 2);
+    Put(data, quirks, 2);
+    Put(data, hz, 4);
+    Put(data, seed, 8);
+    Put(data, romHash, 8);
+    Put(data, endCycle, 8);
+    Put(data, events.size(), 4);
+    for (size_t i = 0; i < events.size(); ++i) {
+        Put(data, events[i].cycle, 8);
+        Put(data, events[i].keys, 2);
+    }
+
+    FILE * pFile = fopen(filename, "wb");
+    if (pFile == NULL) {
+        return false;
+    }
+    bool ok = fwrite(&data[0], 1, data.size(), pFile) == data.size();
+    return (fclose(pFile) == 0) && ok;
+}
+
+bool Chip8InputLog::Load(const char * filename) {
+    FILE * pFile = fopen(filename, "rb");
+    if (pFile == NULL) {
+        return false;
+    }
+
+    // Version 1 has no quirks field, those sessions ran the chip8 profile
+    unsigned char header[INPUT_HEADER_SIZE];
+    if (fread(header, 1, 6, pFile) != 6 || memcmp(header, INPUT_MAGIC, 4) != 0) {
+        fclose(pFile);
+        return false;
+    }
+    const unsigned char * p = header + 4;
+    uint64_t version = Get(p, 2);
+    size_t rest = INPUT_HEADER_SIZE - 6 - (version == 1 ? 2 : 0);
+    if ((version != 1 && version != CHIP8_INPUT_VERSION) || fread(header + 6, 1, rest, pFile) != rest) {
+        fclose(pFile);
+        return false;
+    }
+
+    quirks   = CHIP8_QUIRKS_CHIP8;
+    if (version != 1) {
+        uint64_t profile = Get(p, 2);
+        if (profile >= CHIP8_QUIRKS_COUNT) {
+            fclose(pFile);
+            return false;
+        }
+        quirks = (Chip8Quirks)profile;
+    }
+    hz       = (unsigned long)Get(p, 4);
+    seed     = Get(p, 8);
+    romHash  = Get(p, 8);
+    endCycle = Get(p, 8);
+    size_t count = (size_t)Get(p, 4);
+
+    std::vector<unsigned char> data(count * INPUT_EVENT_SIZE);
+    bool ok = data.empty() || fread(&data[0], 1, data.size(), pFile) == data.size();
+    fclose(pFile);
+    if (!ok) {
+        return false;
+    }
+
+    events.resize(count);
+    p = data.empty() ? NULL : &data[0];
+    for (size_t i = 0; i < count; ++i) {
+        events[i].cycle = Get(p, 8);
+        events[i].keys  = (unsigned short)Get(p, 2);
+    }
+    lastKeys = count > 0 ? events[count - 1].keys : 0;
+    return true;
+}
+
+bool Chip8InputLog::Replay(Chip8 & c8, const unsigned char * rom, long size) const {
+    if (HashRom(rom, size) != romHash || hz == 0) {
+        return false;
+    }
+
+    c8.Seed(seed);
+    c8.SetQuirks(quirks);
+    if (!c8.LoadApplication(rom, size)) {
+        return false;
+    }
+
+    // Same frames as the recording: batches of the scheduler's size, a
+    // timer tick after each, keys changed only at event cycles
+    Chip8Scheduler scheduler(hz);
+    size_t next = 0;
+    while (c8.GetCycles() < endCycle) {
+        uint64_t frameEnd = c8.GetCycles() + scheduler.NextFrameCycles();
+        bool whole = frameEnd <= endCycle;
+        if (!whole) {
+            frameEnd = endCycle;
+        }
+
+        while (c8.GetCycles() < frameEnd) {
+            while (next < events.size() && events[next].cycle <= c8.GetCycles()) {
+                c8.SetKeys(events[next++].keys);
+            }
+            uint64_t stop = frameEnd;
+            if (next < events.size() && events[next].cycle < stop) {
+                stop = events[next].cycle;
+            }
+            c8.Run((unsigned long)(stop - c8.GetCycles()));
+        }
+
+        if (whole) {
+            c8.TickTimers();
+        }
+    }
+    return true;
+}
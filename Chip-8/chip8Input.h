@@ -0,0 +1,66 @@
+/*
+ * chip8Input.h
+ *  - Input log for deterministic replay. A session is fully determined by
+ *    the ROM, the RNG seed, the quirks profile, the CPU rate and the key[]
+ *    state at every cycle, so the log stores the first four plus one event
+ *    per change of the key bitmask, keyed by the cycle it took effect at.
+ *
+ *    Keys are applied between Run() batches only (the front end samples
+ *    them once per frame), and Replay() runs the same frame schedule, so a
+ *    replay reproduces the recorded session bit for bit, in any exec mode
+ *    and as fast as the host allows.
+ */
+
+#include <stdint.h>
+#include <vector>
+#include "chip8.h"
+
+#ifndef __CHIP8INPUT__
+#define __CHIP8INPUT__
+
+#define CHIP8_INPUT_VERSION 2
+
+struct Chip8InputEvent {
+    uint64_t       cycle;
+    unsigned short keys;        // Bit n = key n down
+};
+
+class Chip8InputLog {
+
+    public:
+
+        Chip8InputLog();
+
+        // Recording. Begin() right after LoadApplication(), Record() before
+        // every Run() batch, End() when the session stops.
+        void Begin(const Chip8 & c8, const unsigned char * rom, long size, unsigned long hz);
+        void Record(const Chip8 & c8);
+        void End(const Chip8 & c8);
+
+        bool Save(const char * filename) const;
+        bool Load(const char * filename);
+
+        // Load the ROM into c8 and run the whole session (false if the log
+        // was recorded with another ROM)
+        bool Replay(Chip8 & c8, const unsigned char * rom, long size) const;
+
+        uint64_t      GetSeed() const      { return seed; }
+        Chip8Quirks   GetQuirks() const    { return quirks; }
+        unsigned long GetFrequency() const { return hz; }
+        uint64_t      GetEndCycle() const  { return endCycle; }
+        size_t        GetEventCount() const { return events.size(); }
+
+        static uint64_t HashRom(const unsigned char * rom, long size);
+
+    private:
+
+        uint64_t                     seed;
+        unsigned long                hz;
+        Chip8Quirks                  quirks;
+        uint64_t                     romHash;
+        uint64_t                     endCycle;
+        std::vector<Chip8InputEvent> events;
+        unsigned short               lastKeys;
+};
+
+#endif
@@ -0,0 +1,895 @@
+/*
+ * chip8Jit.cpp
+ *  - Register usage inside translated code:
+ *      rbx         Chip8JitContext
+ *      r12d        I
+ *      r13         Remaining cycle budget
+ *      eax/ecx/edx Scratch
+ *      esi, edi, r8d-r11d, ebp, r14d, r15d
+ *                  V registers, allocated per block by use count. V values
+ *                  stay zero extended to 32 bits. Registers that don't get
+ *                  a host register are accessed in the context.
+ *
+ *    Blocks end at 1NNN / 2NNN / 00EE / BNNN, at every skip opcode, and at
+ *    FX0A / FX33 / FX55. Static exits are chained with a patched jmp, 00EE
+ *    and BNNN look the target up in the entry table. Every block checks the
+ *    budget for its full length on entry, so cycle counts stay exact.
+ *
+ *    Writes through Chip8::StoreByte() that hit a compiled byte flush the
+ *    cache. FX33 / FX55 end their block and leave native code when that
+ *    happens, so a block never keeps running over code it overwrote.
+ *
+ *    SUPER-CHIP / XO-CHIP display opcodes, XO-CHIP's 16 bit memory
+ *    accesses and F000 NNNN aren't translated: a block ends in front of
+ *    them and the dispatcher runs them on the interpreter (EXIT_STEP).
+ */
+
+#include "chip8Jit.h"
+
+#if defined(__x86_64__)
+#include <stddef.h>
+#include <sys/mman.h>
+#define JIT_SUPPORTED 1
+#else
+#define JIT_SUPPORTED 0
+#endif
+
+#define JIT_CODE_SIZE   (4 * 1024 * 1024)
+#define JIT_BLOCK_SPACE (16 * 1024)     // Worst case size of one block
+#define JIT_MAX_BLOCK   64              // Instructions per block
+
+// Host registers
+enum { RAX = 0, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+
+// Condition codes
+enum { CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_A = 0x7 };
+
+// ALU opcodes (reg, reg) and /ext for 0x81 (reg, imm32)
+enum { ALU_ADD = 0x01, ALU_OR = 0x09, ALU_AND = 0x21, ALU_SUB = 0x29, ALU_XOR = 0x31, ALU_CMP = 0x39 };
+enum { EXT_ADD = 0, EXT_AND = 4, EXT_CMP = 7 };
+
+// Why native code returned to the dispatcher
+enum { EXIT_DISPATCH = 0, EXIT_BUDGET, EXIT_WAIT, EXIT_FLUSH, EXIT_STEP };
+
+static const int vPool[] = { RSI, RDI, R8, R9, R10, R11, RBP, R14, R15 };
+static const int vPoolSize = sizeof(vPool) / sizeof(vPool[0]);
+
+#define CTX_V(v)    ((int)(offsetof(Chip8JitContext, V) + (v)))
+#define CTX_I       ((int)offsetof(Chip8JitContext, I))
+#define CTX_PC      ((int)offsetof(Chip8JitContext, pc))
+#define CTX_SP      ((int)offsetof(Chip8JitContext, sp))
+#define CTX_STACK   ((int)offsetof(Chip8JitContext, stack))
+#define CTX_BUDGET  ((int)offsetof(Chip8JitContext, budget))
+#define CTX_KEY     ((int)offsetof(Chip8JitContext, key))
+
+Chip8Jit::Chip8Jit() : code(NULL), codeSize(0), codeUsed(0), blockStart(0), enter(NULL), exitCommon(NULL), dirty(false) {
+#if JIT_SUPPORTED
+    void * mem = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        return;
+    }
+    code     = (unsigned char *)mem;
+    codeSize = JIT_CODE_SIZE;
+
+    EmitTrampoline();
+    blockStart = codeUsed;
+#endif
+    Flush();
+}
+
+Chip8Jit::~Chip8Jit() {
+#if JIT_SUPPORTED
+    if (code != NULL) {
+        munmap(code, codeSize);
+    }
+#endif
+}
+
+void Chip8Jit::Flush() {
+    codeUsed = blockStart;
+    memset(entries, 0x00, sizeof(entries));
+    memset(codeMap, 0x00, sizeof(codeMap));
+    for (int i = 0; i < 4096; ++i) {
+        pending[i].clear();
+    }
+    dirty = false;
+}
+
+void Chip8Jit::Invalidate(unsigned short addr) {
+    addr &= 0x0FFF;
+    if ((codeMap[addr >> 6] >> (addr & 63)) & 1) {
+        dirty = true;
+    }
+}
+
+void Chip8::JitInvalidate(unsigned short addr) {
+    jit->Invalidate(addr);
+}
+
+void Chip8Jit::Run(Chip8 & c8, unsigned long cycles) {
+    if (dirty) {
+        Flush();
+    }
+
+    memcpy(ctx.V, c8.V, sizeof(ctx.V));
+    memcpy(ctx.stack, c8.stack, sizeof(ctx.stack));
+    ctx.I            = c8.I;
+    ctx.pc           = c8.pc & 0x0FFF;
+    ctx.sp           = c8.sp;
+    ctx.budget       = cycles;
+    ctx.key          = c8.key;
+    ctx.c8           = &c8;
+    ctx.jit          = this;
+
+    bool waiting = false;
+    while (ctx.budget > 0) {
+        void * block = entries[ctx.pc & 0x0FFF];
+        if (block == NULL) {
+            block = Compile(c8, ctx.pc & 0x0FFF);
+        }
+
+        int reason = enter(&ctx, block);
+        if (reason == EXIT_FLUSH) {
+            Flush();
+        } else if (reason == EXIT_BUDGET) {
+            break;
+        } else if (reason == EXIT_WAIT) {
+            // FX0A without a key spends the rest of the budget
+            waiting = true;
+            break;
+        } else if (reason == EXIT_STEP && ctx.budget > 0) {
+            Step(c8);
+        }
+    }
+
+    memcpy(c8.V, ctx.V, sizeof(ctx.V));
+    memcpy(c8.stack, ctx.stack, sizeof(ctx.stack));
+    c8.I           = ctx.I;
+    c8.pc          = ctx.pc;
+    c8.sp          = ctx.sp;
+
+    // The next block is longer than what is left, finish on the interpreter
+    if (!waiting) {
+        for (unsigned long i = 0; i < ctx.budget; ++i) {
+            c8.EmulateCycle();
+        }
+    }
+}
+
+// One instruction at ctx.pc on the interpreter
+void Chip8Jit::Step(Chip8 & c8) {
+    memcpy(c8.V, ctx.V, sizeof(ctx.V));
+    memcpy(c8.stack, ctx.stack, sizeof(ctx.stack));
+    c8.I  = ctx.I;
+    c8.pc = ctx.pc;
+    c8.sp = ctx.sp;
+
+    c8.EmulateCycle();
+    ctx.budget--;
+
+    // 00FD stays put, same as the other engines it ends the Run()
+    if (c8.pc == ctx.pc && c8.memory[ctx.pc] == 0x00 && c8.memory[(ctx.pc + 1) & 0x0FFF] == 0xFD) {
+        ctx.budget = 0;
+    }
+
+    memcpy(ctx.V, c8.V, sizeof(ctx.V));
+    memcpy(ctx.stack, c8.stack, sizeof(ctx.stack));
+    ctx.I  = c8.I;
+    ctx.pc = c8.pc;
+    ctx.sp = c8.sp;
+    if (dirty) {
+        Flush();
+    }
+}
+
+/*
+ * Helpers called from native code. The context is up to date when they run
+ * (allocated V registers, I and r13 are spilled around the call).
+ */
+
+void Chip8Jit::JitCls(Chip8JitContext * c) {
+    c->c8->ClearScreen();
+}
+
+void Chip8Jit::JitRnd(Chip8JitContext * c, int x, int nn) {
+    c->V[x] = (c->c8->Random() % 0xFF) & nn;
+}
+
+template <bool wrap>
+void Chip8Jit::JitDraw(Chip8JitContext * c, int x, int y, int n) {
+    c->V[0xF] = c->c8->DrawSprite<wrap>(c->V[x], c->V[y], n, c->I);
+}
+
+void Chip8Jit::JitGetDelay(Chip8JitContext * c, int x) {
+    c->V[x] = c->c8->timer_delay;
+}
+
+void Chip8Jit::JitSetDelay(Chip8JitContext * c, int x) {
+    c->c8->timer_delay = c->V[x];
+}
+
+void Chip8Jit::JitSetSound(Chip8JitContext * c, int x) {
+    c->c8->timer_sound = c->V[x];
+}
+
+int Chip8Jit::JitWaitKey(Chip8JitContext * c, int x) {
+    bool keyPress = false;
+    for (int i = 0; i < 16; ++i) {
+        if (c->key[i] != 0) {
+            c->V[x] = i;
+            keyPress = true;
+        }
+    }
+    return keyPress;
+}
+
+int Chip8Jit::JitStoreBCD(Chip8JitContext * c, int x) {
+    unsigned char vx = c->V[x];
+    c->c8->StoreByte( c->I      & 0x0FFF,  vx / 100);
+    c->c8->StoreByte((c->I + 1) & 0x0FFF, (vx / 10) % 10);
+    c->c8->StoreByte((c->I + 2) & 0x0FFF, (vx % 100) % 10);
+    return c->jit->dirty;
+}
+
+template <bool incI>
+int Chip8Jit::JitStoreRegs(Chip8JitContext * c, int x) {
+    for (int i = 0; i <= x; ++i) {
+        c->c8->StoreByte((c->I + i) & 0x0FFF, c->V[i]);
+    }
+    if (incI) {
+        c->I = (c->I + x + 1) & 0xFFFF;
+    }
+    return c->jit->dirty;
+}
+
+template <bool incI>
+void Chip8Jit::JitLoadRegs(Chip8JitContext * c, int x) {
+    for (int i = 0; i <= x; ++i) {
+        c->V[i] = c->c8->memory[(c->I + i) & 0x0FFF];
+    }
+    if (incI) {
+        c->I = (c->I + x + 1) & 0xFFFF;
+    }
+}
+
+void Chip8Jit::JitUnknown(Chip8JitContext * c, int opcode) {
+    printf("Unknown opcode [0x0000]: 0x%X\n", opcode);
+}
+
+/*
+ * Instruction encoding
+ */
+
+void Chip8Jit::Emit8(unsigned char b) {
+    code[codeUsed++] = b;
+}
+
+void Chip8Jit::Emit32(unsigned int v) {
+    memcpy(code + codeUsed, &v, 4);
+    codeUsed += 4;
+}
+
+void Chip8Jit::Emit64(unsigned long long v) {
+    memcpy(code + codeUsed, &v, 8);
+    codeUsed += 8;
+}
+
+// byteRegs: reg / rm name 8-bit registers, spl..dil need a REX prefix
+void Chip8Jit::Rex(bool w, int reg, int rm, bool byteRegs) {
+    unsigned char rex = 0x40 | (w ? 0x08 : 0) | ((reg & 8) ? 0x04 : 0) | ((rm & 8) ? 0x01 : 0);
+    bool needed = (rex != 0x40) || (byteRegs && ((reg >= 4 && reg <= 7) || (rm >= 4 && rm <= 7)));
+    if (needed) {
+        Emit8(rex);
+    }
+}
+
+void Chip8Jit::ModRM(int mod, int reg, int rm) {
+    Emit8((mod << 6) | ((reg & 7) << 3) | (rm & 7));
+}
+
+// All memory operands are [rbx + disp32]
+void Chip8Jit::MovzxRegMem8(int reg, int disp) {
+    Rex(false, reg, RBX, false);
+    Emit8(0x0F); Emit8(0xB6);
+    ModRM(2, reg, RBX);
+    Emit32(disp);
+}
+
+void Chip8Jit::MovMem8Reg(int disp, int reg) {
+    Rex(false, reg, RBX, reg >= 4 && reg <= 7);
+    Emit8(0x88);
+    ModRM(2, reg, RBX);
+    Emit32(disp);
+}
+
+void Chip8Jit::MovMem8Imm(int disp, unsigned char imm) {
+    Emit8(0xC6);
+    ModRM(2, 0, RBX);
+    Emit32(disp);
+    Emit8(imm);
+}
+
+void Chip8Jit::MovRegMem32(int reg, int disp) {
+    Rex(false, reg, RBX, false);
+    Emit8(0x8B);
+    ModRM(2, reg, RBX);
+    Emit32(disp);
+}
+
+void Chip8Jit::MovMem32Reg(int disp, int reg) {
+    Rex(false, reg, RBX, false);
+    Emit8(0x89);
+    ModRM(2, reg, RBX);
+    Emit32(disp);
+}
+
+void Chip8Jit::MovMem32Imm(int disp, unsigned int imm) {
+    Emit8(0xC7);
+    ModRM(2, 0, RBX);
+    Emit32(disp);
+    Emit32(imm);
+}
+
+void Chip8Jit::MovRegReg(int dst, int src) {
+    Rex(false, src, dst, false);
+    Emit8(0x89);
+    ModRM(3, src, dst);
+}
+
+void Chip8Jit::MovRegImm(int reg, unsigned int imm) {
+    Rex(false, 0, reg, false);
+    Emit8(0xB8 + (reg & 7));
+    Emit32(imm);
+}
+
+void Chip8Jit::MovzxRegReg8(int dst, int src) {
+    Rex(false, dst, src, true);
+    Emit8(0x0F); Emit8(0xB6);
+    ModRM(3, dst, src);
+}
+
+void Chip8Jit::AluRegReg(unsigned char op, int dst, int src) {
+    Rex(false, src, dst, false);
+    Emit8(op);
+    ModRM(3, src, dst);
+}
+
+void Chip8Jit::AluRegImm(int ext, int reg, unsigned int imm) {
+    Rex(false, 0, reg, false);
+    Emit8(0x81);
+    ModRM(3, ext, reg);
+    Emit32(imm);
+}
+
+// ext 4 = shl, 5 = shr
+void Chip8Jit::ShiftRegImm(int ext, int reg, unsigned char count) {
+    Rex(false, 0, reg, false);
+    Emit8(0xC1);
+    ModRM(3, ext, reg);
+    Emit8(count);
+}
+
+void Chip8Jit::SetCC(int cc, int reg) {
+    Rex(false, 0, reg, true);
+    Emit8(0x0F); Emit8(0x90 + cc);
+    ModRM(3, 0, reg);
+}
+
+unsigned int Chip8Jit::Jcc(int cc) {
+    Emit8(0x0F); Emit8(0x80 + cc);
+    Emit32(0);
+    return codeUsed - 4;
+}
+
+unsigned int Chip8Jit::Jmp() {
+    Emit8(0xE9);
+    Emit32(0);
+    return codeUsed - 4;
+}
+
+void Chip8Jit::JmpTo(const void * target) {
+    PatchRel32(Jmp(), target);
+}
+
+void Chip8Jit::PatchRel32(unsigned int pos, const void * target) {
+    int rel = (int)((const unsigned char *)target - (code + pos + 4));
+    memcpy(code + pos, &rel, 4);
+}
+
+// helper(ctx, a1, a2, a3) with the allocated registers, I and r13 spilled
+void Chip8Jit::CallHelper(const void * fn, int a1, int a2, int a3) {
+    StoreAllocated(false);
+    MovMem32Reg(CTX_I, R12);
+    Emit8(0x4C); Emit8(0x89); ModRM(2, R13, RBX); Emit32(CTX_BUDGET);   // mov [rbx+budget], r13
+
+    Emit8(0x48); Emit8(0x89); Emit8(0xDF);                              // mov rdi, rbx
+    MovRegImm(RSI, a1);
+    MovRegImm(RDX, a2);
+    MovRegImm(RCX, a3);
+    Emit8(0x48); Emit8(0xB8); Emit64((unsigned long long)fn);           // mov rax, fn
+    Emit8(0xFF); Emit8(0xD0);                                           // call rax
+
+    LoadAllocated();
+    MovRegMem32(R12, CTX_I);
+}
+
+/*
+ * Block level helpers
+ */
+
+void Chip8Jit::LoadV(int reg, int v) {
+    if (alloc[v] >= 0) {
+        MovRegReg(reg, alloc[v]);
+    } else {
+        MovzxRegMem8(reg, CTX_V(v));
+    }
+}
+
+// reg must hold a value in 0..255
+void Chip8Jit::StoreV(int v, int reg) {
+    if (alloc[v] >= 0) {
+        MovRegReg(alloc[v], reg);
+    } else {
+        MovMem8Reg(CTX_V(v), reg);
+    }
+    written[v] = true;
+}
+
+void Chip8Jit::LoadAllocated() {
+    for (int v = 0; v < 16; ++v) {
+        if (alloc[v] >= 0) {
+            MovzxRegMem8(alloc[v], CTX_V(v));
+        }
+    }
+}
+
+void Chip8Jit::StoreAllocated(bool writtenOnly) {
+    for (int v = 0; v < 16; ++v) {
+        if (alloc[v] >= 0 && (!writtenOnly || written[v])) {
+            MovMem8Reg(CTX_V(v), alloc[v]);
+        }
+    }
+}
+
+void Chip8Jit::ExitStatic(unsigned short target) {
+    target &= 0x0FFF;
+    StoreAllocated(true);
+
+    if (entries[target] != NULL) {
+        JmpTo(entries[target]);
+    } else {
+        Stub stub = { Jmp(), target };
+        stubs.push_back(stub);
+    }
+}
+
+void Chip8Jit::ExitDynamic() {
+    MovMem32Reg(CTX_PC, RCX);
+    StoreAllocated(true);
+
+    Emit8(0x48); Emit8(0xBA); Emit64((unsigned long long)entries);     // mov rdx, entries
+    Emit8(0x48); Emit8(0x8B); Emit8(0x04); Emit8(0xCA);                 // mov rax, [rdx + rcx*8]
+    Emit8(0x48); Emit8(0x85); Emit8(0xC0);                              // test rax, rax
+    unsigned int notCompiled = Jcc(CC_E);
+    Emit8(0xFF); Emit8(0xE0);                                           // jmp rax
+
+    PatchRel32(notCompiled, code + codeUsed);
+    MovRegImm(RAX, EXIT_DISPATCH);
+    JmpTo(exitCommon);
+}
+
+void Chip8Jit::ExitReason(unsigned short pcValue, int reason) {
+    StoreAllocated(true);
+    MovMem32Imm(CTX_PC, pcValue & 0x0FFF);
+    MovRegImm(RAX, reason);
+    JmpTo(exitCommon);
+}
+
+void Chip8Jit::EmitTrampoline() {
+    // int enter(Chip8JitContext * ctx, void * block)
+    enter = (EnterFn)(code + codeUsed);
+    Emit8(0x53);                                    // push rbx
+    Emit8(0x55);                                    // push rbp
+    Emit8(0x41); Emit8(0x54);                       // push r12
+    Emit8(0x41); Emit8(0x55);                       // push r13
+    Emit8(0x41); Emit8(0x56);                       // push r14
+    Emit8(0x41); Emit8(0x57);                       // push r15
+    Emit8(0x48); Emit8(0x83); Emit8(0xEC); Emit8(0x08); // sub rsp, 8 (16 byte alignment for helper calls)
+    Emit8(0x48); Emit8(0x89); Emit8(0xFB);          // mov rbx, rdi
+    MovRegMem32(R12, CTX_I);
+    Emit8(0x4C); Emit8(0x8B); ModRM(2, R13, RBX); Emit32(CTX_BUDGET);   // mov r13, [rbx+budget]
+    Emit8(0xFF); Emit8(0xE6);                       // jmp rsi
+
+    // Every exit lands here with the reason in eax
+    exitCommon = code + codeUsed;
+    Emit8(0x4C); Emit8(0x89); ModRM(2, R13, RBX); Emit32(CTX_BUDGET);   // mov [rbx+budget], r13
+    MovMem32Reg(CTX_I, R12);
+    Emit8(0x48); Emit8(0x83); Emit8(0xC4); Emit8(0x08); // add rsp, 8
+    Emit8(0x41); Emit8(0x5F);                       // pop r15
+    Emit8(0x41); Emit8(0x5E);                       // pop r14
+    Emit8(0x41); Emit8(0x5D);                       // pop r13
+    Emit8(0x41); Emit8(0x5C);                       // pop r12
+    Emit8(0x5D);                                    // pop rbp
+    Emit8(0x5B);                                    // pop rbx
+    Emit8(0xC3);                                    // ret
+}
+
+// Left to the interpreter under the given instruction set
+static bool Interpreted(unsigned char op, int isa) {
+    if (isa == CHIP8_ISA_CHIP8) {
+        return false;
+    }
+    if (op >= OP_SCD && op < OP_UNKNOWN) {
+        return true;
+    }
+    switch (op) {
+        case OP_DRW:
+            return true;
+        case OP_ADD_I:  case OP_LD_B:   case OP_LD_MEM_VX:  case OP_LD_VX_MEM:
+            return isa == CHIP8_ISA_XO;
+    }
+    return false;
+}
+
+static bool IsSkip(unsigned char op) {
+    switch (op) {
+        case OP_SE_NN:  case OP_SNE_NN: case OP_SE_VY:  case OP_SNE_VY:
+        case OP_SKP:    case OP_SKNP:
+            return true;
+    }
+    return false;
+}
+
+static bool EndsBlock(unsigned char op) {
+    switch (op) {
+        case OP_JP:     case OP_CALL:   case OP_RET:    case OP_JP_V0:
+        case OP_SE_NN:  case OP_SNE_NN: case OP_SE_VY:  case OP_SNE_VY:
+        case OP_SKP:    case OP_SKNP:
+        case OP_LD_VX_K: case OP_LD_B:  case OP_LD_MEM_VX:
+            return true;
+    }
+    return false;
+}
+
+void * Chip8Jit::Compile(const Chip8 & c8, unsigned short start) {
+    if (codeSize - codeUsed < JIT_BLOCK_SPACE) {
+        Flush();
+    }
+
+    // Quirks are resolved here, native code has no tests for them
+    const Chip8QuirkFlags & quirks = Chip8GetQuirkFlags(c8.GetQuirks());
+
+    // Scan the block
+    Chip8Instr     instrs[JIT_MAX_BLOCK];
+    unsigned short addrs[JIT_MAX_BLOCK];
+    unsigned short opcodes[JIT_MAX_BLOCK];
+    int            uses[16] = { 0 };
+    int            count = 0;
+    unsigned short addr  = start;
+    bool           step  = false;   // Ends in front of an interpreted instruction at addr
+
+    while (count < JIT_MAX_BLOCK) {
+        opcodes[count] = (c8.memory[addr] << 8) | c8.memory[(addr + 1) & 0x0FFF];
+        instrs[count]  = Chip8Decode(opcodes[count], quirks.isa);
+        if (Interpreted(instrs[count].op, quirks.isa)) {
+            step = true;
+            break;
+        }
+        addrs[count]   = addr;
+        uses[instrs[count].x]++;
+        uses[instrs[count].y]++;
+        codeMap[addr >> 6] |= 1ULL << (addr & 63);
+        codeMap[((addr + 1) & 0x0FFF) >> 6] |= 1ULL << ((addr + 1) & 63);
+
+        if (EndsBlock(instrs[count++].op) || addr + OPCODE_LEN > 0x0FFF) {
+            break;
+        }
+        addr += OPCODE_LEN;
+    }
+
+    // XO-CHIP skips jump over F000 NNNN whole, the length is read here and
+    // the instruction after the skip joins the block's code bytes
+    unsigned short skipLen = OPCODE_LEN;
+    if (!step && quirks.isa == CHIP8_ISA_XO && IsSkip(instrs[count - 1].op)) {
+        unsigned short next = (addrs[count - 1] + OPCODE_LEN) & 0x0FFF;
+        if (c8.memory[next] == 0xF0 && c8.memory[(next + 1) & 0x0FFF] == 0x00) {
+            skipLen = 2 * OPCODE_LEN;
+        }
+        codeMap[next >> 6] |= 1ULL << (next & 63);
+        codeMap[((next + 1) & 0x0FFF) >> 6] |= 1ULL << ((next + 1) & 63);
+    }
+
+    // Give the most used V registers a host register
+    int order[16];
+    for (int v = 0; v < 16; ++v) {
+        order[v]   = v;
+        alloc[v]   = -1;
+        written[v] = false;
+    }
+    for (int i = 1; i < 16; ++i) {
+        for (int j = i; j > 0 && uses[order[j]] > uses[order[j - 1]]; --j) {
+            int t = order[j]; order[j] = order[j - 1]; order[j - 1] = t;
+        }
+    }
+    for (int i = 0; i < vPoolSize && uses[order[i]] > 0; ++i) {
+        alloc[order[i]] = vPool[i];
+    }
+    stubs.clear();
+
+    // Entry: check the budget for the whole block
+    unsigned char * entry = code + codeUsed;
+    entries[start] = entry;
+
+    Emit8(0x49); Emit8(0x81); Emit8(0xFD); Emit32(count);  // cmp r13, count
+    unsigned int noBudget = Jcc(CC_B);
+    Emit8(0x49); Emit8(0x81); Emit8(0xED); Emit32(count);  // sub r13, count
+    LoadAllocated();
+
+    bool open = true;       // Falls through past the last instruction
+    for (int k = 0; k < count; ++k) {
+        const Chip8Instr & in = instrs[k];
+        unsigned short     pc = addrs[k];
+        int                x  = in.x;
+        int                y  = in.y;
+        unsigned int       nn = in.nnn & 0x00FF;
+        int                skipCC = -1;
+
+        switch (in.op) {
+            case OP_CLS:
+                CallHelper((const void *)&JitCls, 0, 0, 0);
+                break;
+            case OP_RET:
+                MovRegMem32(RAX, CTX_SP);
+                AluRegImm(EXT_ADD, RAX, 0xFFFFFFFF);
+                AluRegImm(EXT_AND, RAX, 0x0F);
+                MovMem32Reg(CTX_SP, RAX);
+                Emit8(0x0F); Emit8(0xB7); Emit8(0x8C); Emit8(0x43); Emit32(CTX_STACK);  // movzx ecx, word [rbx+rax*2+stack]
+                Emit8(0x66); Emit8(0xC7); Emit8(0x84); Emit8(0x43); Emit32(CTX_STACK);  // mov word [rbx+rax*2+stack], 0
+                Emit8(0x00); Emit8(0x00);
+                AluRegImm(EXT_ADD, RCX, OPCODE_LEN);
+                AluRegImm(EXT_AND, RCX, 0x0FFF);
+                ExitDynamic();
+                open = false;
+                break;
+            case OP_JP:
+                ExitStatic(in.nnn);
+                open = false;
+                break;
+            case OP_CALL:
+                MovRegMem32(RAX, CTX_SP);
+                Emit8(0x66); Emit8(0xC7); Emit8(0x84); Emit8(0x43); Emit32(CTX_STACK);  // mov word [rbx+rax*2+stack], pc
+                Emit8(pc & 0xFF); Emit8(pc >> 8);
+                AluRegImm(EXT_ADD, RAX, 1);
+                AluRegImm(EXT_AND, RAX, 0x0F);
+                MovMem32Reg(CTX_SP, RAX);
+                ExitStatic(in.nnn);
+                open = false;
+                break;
+            case OP_SE_NN:
+            case OP_SNE_NN:
+                LoadV(RAX, x);
+                AluRegImm(EXT_CMP, RAX, nn);
+                skipCC = (in.op == OP_SE_NN) ? CC_E : CC_NE;
+                break;
+            case OP_SE_VY:
+            case OP_SNE_VY:
+                LoadV(RAX, x);
+                LoadV(RCX, y);
+                AluRegReg(ALU_CMP, RAX, RCX);
+                skipCC = (in.op == OP_SE_VY) ? CC_E : CC_NE;
+                break;
+            case OP_LD_NN:
+                if (alloc[x] >= 0) {
+                    MovRegImm(alloc[x], nn);
+                    written[x] = true;
+                } else {
+                    MovMem8Imm(CTX_V(x), nn);
+                }
+                break;
+            case OP_ADD_NN:
+                LoadV(RAX, x);
+                AluRegImm(EXT_ADD, RAX, nn);
+                MovzxRegReg8(RAX, RAX);
+                StoreV(x, RAX);
+                break;
+            case OP_LD_VY:
+                LoadV(RAX, y);
+                StoreV(x, RAX);
+                break;
+            case OP_OR:
+            case OP_AND:
+            case OP_XOR:
+                LoadV(RAX, x);
+                LoadV(RCX, y);
+                AluRegReg(in.op == OP_OR ? ALU_OR : (in.op == OP_AND ? ALU_AND : ALU_XOR), RAX, RCX);
+                StoreV(x, RAX);
+                if (quirks.logicVf) {
+                    MovRegImm(RAX, 0);
+                    StoreV(0xF, RAX);
+                }
+                break;
+
+            // VF first, then VX from the updated registers (same order as EmulateCycle)
+            case OP_ADD_VY:
+                LoadV(RAX, x);
+                LoadV(RCX, y);
+                AluRegReg(ALU_ADD, RAX, RCX);
+                ShiftRegImm(5, RAX, 8);
+                StoreV(0xF, RAX);
+                LoadV(RAX, x);
+                LoadV(RCX, y);
+                AluRegReg(ALU_ADD, RAX, RCX);
+                MovzxRegReg8(RAX, RAX);
+                StoreV(x, RAX);
+                break;
+            case OP_SUB:
+                LoadV(RAX, x);
+                LoadV(RCX, y);
+                AluRegReg(ALU_CMP, RAX, RCX);
+                SetCC(CC_AE, RDX);
+                MovzxRegReg8(RDX, RDX);
+                StoreV(0xF, RDX);
+                LoadV(RAX, x);
+                LoadV(RCX, y);
+                AluRegReg(ALU_SUB, RAX, RCX);
+                MovzxRegReg8(RAX, RAX);
+                StoreV(x, RAX);
+                break;
+            case OP_SHR:
+                if (quirks.shiftVy) {
+                    LoadV(RAX, y);
+                    StoreV(x, RAX);
+                }
+                LoadV(RAX, x);
+                AluRegImm(EXT_AND, RAX, 0x01);
+                StoreV(0xF, RAX);
+                LoadV(RAX, x);
+                ShiftRegImm(5, RAX, 1);
+                StoreV(x, RAX);
+                break;
+            case OP_SUBN:
+                LoadV(RAX, y);
+                LoadV(RCX, x);
+                AluRegReg(ALU_CMP, RAX, RCX);
+                SetCC(CC_AE, RDX);
+                MovzxRegReg8(RDX, RDX);
+                StoreV(0xF, RDX);
+                LoadV(RAX, y);
+                LoadV(RCX, x);
+                AluRegReg(ALU_SUB, RAX, RCX);
+                MovzxRegReg8(RAX, RAX);
+                StoreV(x, RAX);
+                break;
+            case OP_SHL:
+                if (quirks.shiftVy) {
+                    LoadV(RAX, y);
+                    StoreV(x, RAX);
+                }
+                LoadV(RAX, x);
+                ShiftRegImm(5, RAX, 7);
+                StoreV(0xF, RAX);
+                LoadV(RAX, x);
+                ShiftRegImm(4, RAX, 1);
+                MovzxRegReg8(RAX, RAX);
+                StoreV(x, RAX);
+                break;
+            case OP_LD_I:
+                MovRegImm(R12, in.nnn);
+                break;
+            case OP_JP_V0:
+                LoadV(RCX, quirks.jumpVx ? x : 0);
+                AluRegImm(EXT_ADD, RCX, in.nnn);
+                AluRegImm(EXT_AND, RCX, 0x0FFF);
+                ExitDynamic();
+                open = false;
+                break;
+            case OP_RND:
+                CallHelper((const void *)&JitRnd, x, nn, 0);
+                break;
+            case OP_DRW:
+                CallHelper(quirks.wrap ? (const void *)&JitDraw<true> : (const void *)&JitDraw<false>, x, y, in.n);
+                break;
+            case OP_SKP:
+            case OP_SKNP:
+                LoadV(RAX, x);
+                AluRegImm(EXT_AND, RAX, 0x0F);
+                Emit8(0x48); Emit8(0x8B); ModRM(2, RDX, RBX); Emit32(CTX_KEY);  // mov rdx, [rbx+key]
+                Emit8(0x0F); Emit8(0xB6); Emit8(0x04); Emit8(0x02);             // movzx eax, byte [rdx+rax]
+                Emit8(0x85); Emit8(0xC0);                                       // test eax, eax
+                skipCC = (in.op == OP_SKP) ? CC_NE : CC_E;
+                break;
+            case OP_LD_VX_DT:
+                CallHelper((const void *)&JitGetDelay, x, 0, 0);
+                break;
+            case OP_LD_VX_K: {
+                CallHelper((const void *)&JitWaitKey, x, 0, 0);
+                Emit8(0x85); Emit8(0xC0);                                       // test eax, eax
+                unsigned int gotKey = Jcc(CC_NE);
+                ExitReason(pc, EXIT_WAIT);
+                PatchRel32(gotKey, code + codeUsed);
+                ExitStatic(pc + OPCODE_LEN);
+                open = false;
+                break;
+            }
+            case OP_LD_DT_VX:
+                CallHelper((const void *)&JitSetDelay, x, 0, 0);
+                break;
+            case OP_LD_ST_VX:
+                CallHelper((const void *)&JitSetSound, x, 0, 0);
+                break;
+            case OP_ADD_I:
+                LoadV(RAX, x);
+                MovRegReg(RCX, R12);
+                AluRegReg(ALU_ADD, RCX, RAX);
+                AluRegImm(EXT_CMP, RCX, 0x0FFF);
+                SetCC(CC_A, RDX);
+                MovzxRegReg8(RDX, RDX);
+                StoreV(0xF, RDX);
+                LoadV(RAX, x);
+                AluRegReg(ALU_ADD, R12, RAX);
+                Emit8(0x45); Emit8(0x0F); Emit8(0xB7); Emit8(0xE4);             // movzx r12d, r12w
+                break;
+            case OP_LD_F:
+                LoadV(RAX, x);
+                Emit8(0x8D); Emit8(0x04); Emit8(0x80);                          // lea eax, [rax+rax*4]
+                MovRegReg(R12, RAX);
+                break;
+            case OP_LD_B:
+            case OP_LD_MEM_VX: {
+                const void * store = quirks.memIncI ? (const void *)&JitStoreRegs<true> : (const void *)&JitStoreRegs<false>;
+                CallHelper(in.op == OP_LD_B ? (const void *)&JitStoreBCD : store, x, 0, 0);
+                Emit8(0x85); Emit8(0xC0);                                       // test eax, eax
+                unsigned int clean = Jcc(CC_E);
+                ExitReason(pc + OPCODE_LEN, EXIT_FLUSH);
+                PatchRel32(clean, code + codeUsed);
+                ExitStatic(pc + OPCODE_LEN);
+                open = false;
+                break;
+            }
+            case OP_LD_VX_MEM:
+                CallHelper(quirks.memIncI ? (const void *)&JitLoadRegs<true> : (const void *)&JitLoadRegs<false>, x, 0, 0);
+                break;
+            default:
+                CallHelper((const void *)&JitUnknown, opcodes[k], 0, 0);
+                break;
+        }
+
+        if (skipCC >= 0) {
+            unsigned int skip = Jcc(skipCC);
+            ExitStatic(pc + OPCODE_LEN);
+            PatchRel32(skip, code + codeUsed);
+            ExitStatic(pc + OPCODE_LEN + skipLen);
+            open = false;
+        }
+    }
+
+    if (step) {
+        ExitReason(addr, EXIT_STEP);
+    } else if (open) {
+        ExitStatic(addrs[count - 1] + OPCODE_LEN);
+    }
+
+    // Out of budget: leave before anything ran
+    PatchRel32(noBudget, code + codeUsed);
+    MovMem32Imm(CTX_PC, start);
+    MovRegImm(RAX, EXIT_BUDGET);
+    JmpTo(exitCommon);
+
+    // Exits to blocks that don't exist yet go through the dispatcher until
+    // the target gets compiled and the jump is patched.
+    for (size_t i = 0; i < stubs.size(); ++i) {
+        PatchRel32(stubs[i].pos, code + codeUsed);
+        pending[stubs[i].target].push_back(stubs[i].pos);
+        MovMem32Imm(CTX_PC, stubs[i].target);
+        MovRegImm(RAX, EXIT_DISPATCH);
+        JmpTo(exitCommon);
+    }
+
+    // Chain everything that was waiting for this block
+    for (size_t i = 0; i < pending[start].size(); ++i) {
+        PatchRel32(pending[start][i], entry);
+    }
+    pending[start].clear();
+
+    return entry;
+}
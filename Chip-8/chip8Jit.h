@@ -0,0 +1,120 @@
+/*
+ * chip8Jit.h
+ *  - x86-64 dynamic recompiler for the Chip-8 CPU. Basic blocks are
+ *    translated to native code on first execution, cached per start address
+ *    and chained to each other. Chip8::EmulateCycle() stays the reference:
+ *    whatever doesn't fit the cycle budget is finished by the interpreter.
+ */
+
+#include <vector>
+#include "chip8.h"
+
+#ifndef __CHIP8JIT__
+#define __CHIP8JIT__
+
+// Live machine state while native code runs. rbx points here.
+struct Chip8JitContext {
+    unsigned char    V[16];
+    unsigned int     I;
+    unsigned int     pc;
+    unsigned int     sp;
+    unsigned short   stack[16];
+    unsigned long    budget;        // Cycles left (r13 while in native code)
+    unsigned char *  key;
+    Chip8 *          c8;
+    Chip8Jit *       jit;
+};
+
+class Chip8Jit {
+
+    public:
+
+        Chip8Jit();
+        ~Chip8Jit();
+
+        bool Ok() const { return code != NULL; }
+
+        void Run(Chip8 & c8, unsigned long cycles);
+        void Invalidate(unsigned short addr);   // Memory write at addr
+        void Flush();                           // Drop all compiled blocks
+
+    private:
+
+        typedef int (*EnterFn)(Chip8JitContext * ctx, void * block);
+
+        void * Compile(const Chip8 & c8, unsigned short start);
+        void   Step(Chip8 & c8);
+        void   EmitTrampoline();
+
+        // Instruction encoding
+        void Emit8(unsigned char b);
+        void Emit32(unsigned int v);
+        void Emit64(unsigned long long v);
+        void Rex(bool w, int reg, int rm, bool byteRegs);
+        void ModRM(int mod, int reg, int rm);
+        void MovzxRegMem8(int reg, int disp);
+        void MovMem8Reg(int disp, int reg);
+        void MovMem8Imm(int disp, unsigned char imm);
+        void MovRegMem32(int reg, int disp);
+        void MovMem32Reg(int disp, int reg);
+        void MovMem32Imm(int disp, unsigned int imm);
+        void MovRegReg(int dst, int src);
+        void MovRegImm(int reg, unsigned int imm);
+        void MovzxRegReg8(int dst, int src);
+        void AluRegReg(unsigned char op, int dst, int src);
+        void AluRegImm(int ext, int reg, unsigned int imm);
+        void ShiftRegImm(int ext, int reg, unsigned char count);
+        void SetCC(int cc, int reg);
+        unsigned int Jcc(int cc);               // Returns the rel32 position to patch
+        unsigned int Jmp();
+        void JmpTo(const void * target);
+        void PatchRel32(unsigned int pos, const void * target);
+        void CallHelper(const void * fn, int a1, int a2, int a3);
+
+        // Block level helpers
+        void LoadV(int reg, int v);
+        void StoreV(int v, int reg);
+        void LoadAllocated();
+        void StoreAllocated(bool writtenOnly);
+        void ExitStatic(unsigned short target);
+        void ExitDynamic();                     // Next pc in ecx
+        void ExitReason(unsigned short pcValue, int reason);
+
+        unsigned char *   code;                 // RWX code buffer
+        unsigned int      codeSize;
+        unsigned int      codeUsed;
+        unsigned int      blockStart;           // First byte after the trampoline
+        EnterFn           enter;
+        unsigned char *   exitCommon;
+
+        void *            entries[4096];        // Compiled block per start address
+        std::vector<unsigned int> pending[4096];// Exit jumps waiting for a block
+        unsigned long long codeMap[64];         // Chip-8 bytes covered by compiled code
+        bool              dirty;                // Compiled code was overwritten
+
+        // Called from native code
+        static void JitCls(Chip8JitContext * c);
+        static void JitRnd(Chip8JitContext * c, int x, int nn);
+        template <bool wrap>
+        static void JitDraw(Chip8JitContext * c, int x, int y, int n);
+        static void JitGetDelay(Chip8JitContext * c, int x);
+        static void JitSetDelay(Chip8JitContext * c, int x);
+        static void JitSetSound(Chip8JitContext * c, int x);
+        static int  JitWaitKey(Chip8JitContext * c, int x);
+        static int  JitStoreBCD(Chip8JitContext * c, int x);
+        template <bool incI>
+        static int  JitStoreRegs(Chip8JitContext * c, int x);
+        template <bool incI>
+        static void JitLoadRegs(Chip8JitContext * c, int x);
+        static void JitUnknown(Chip8JitContext * c, int opcode);
+
+        // Per block register allocation (-1 = V register stays in memory)
+        int               alloc[16];
+        bool              written[16];
+        struct Stub { unsigned int pos; unsigned short target; };
+        std::vector<Stub> stubs;
+
+        Chip8JitContext   ctx;
+};
+
+#endif
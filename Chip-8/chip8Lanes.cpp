@@ -0,0 +1,641 @@
+/*
+ * chip8Lanes.cpp
+ *  - Lockstep lane engine, see chip8Lanes.h
+ *
+ *    The group kernels work on 64 lanes at a time with GCC vector types and
+ *    fold the group mask in as a select, no branches. StepGroup() and Step()
+ *    are compiled once per target and dispatched at load time.
+ */
+
+#include <algorithm>
+#include "chip8Lanes.h"
+
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__)
+#define LANE_KERNEL __attribute__((target_clones("arch=x86-64-v4", "arch=x86-64-v3", "default")))
+#else
+#define LANE_KERNEL
+#endif
+
+#define MAX_GROUPS   8          // PC groups per cycle before going lane by lane
+#define SCALAR_BURST 64         // Cycles run lane by lane before trying lockstep again
+#define MIN_GROUP    4          // Average lanes per group worth staying in lockstep
+
+static const unsigned char chip8_fontset[80] =
+{
+    0xF0, 0x90, 0x90, 0x90, 0xF0, //0
+    0x20, 0x60, 0x20, 0x20, 0x70, //1
+    0xF0, 0x10, 0xF0, 0x80, 0xF0, //2
+    0xF0, 0x10, 0xF0, 0x10, 0xF0, //3
+    0x90, 0x90, 0xF0, 0x10, 0x10, //4
+    0xF0, 0x80, 0xF0, 0x10, 0xF0, //5
+    0xF0, 0x80, 0xF0, 0x90, 0xF0, //6
+    0xF0, 0x10, 0x20, 0x40, 0x40, //7
+    0xF0, 0x90, 0xF0, 0x90, 0xF0, //8
+    0xF0, 0x90, 0xF0, 0x10, 0xF0, //9
+    0xF0, 0x90, 0xF0, 0x90, 0x90, //A
+    0xE0, 0x90, 0xE0, 0x90, 0xE0, //B
+    0xF0, 0x80, 0x80, 0x80, 0xF0, //C
+    0xE0, 0x90, 0x90, 0x90, 0xE0, //D
+    0xF0, 0x80, 0xF0, 0x80, 0xF0, //E
+    0xF0, 0x80, 0xF0, 0x80, 0x80  //F
+};
+
+Chip8Lanes::Chip8Lanes(unsigned int lanes) : lanes(lanes), scalarCycles(0), seed(0), cycleCount(0) {
+    stride = (lanes + 63) & ~63u;
+
+    V.resize(16 * stride);
+    stack.resize(16 * stride);
+    I.resize(stride);
+    pc.resize(stride);
+    sp.resize(stride);
+    timerDelay.resize(stride);
+    timerSound.resize(stride);
+    keys.resize(stride);
+    rng.resize(stride);
+    mem.resize(stride, image);
+    gfx.resize(stride * 32);
+    drawFlag.resize(stride);
+    mask.resize(stride);
+    done.resize(stride, 0xFF);
+    code.resize(4096);
+
+    memset(&stats, 0x00, sizeof(stats));
+    LoadApplication(NULL, 0);
+}
+
+Chip8Lanes::~Chip8Lanes() {
+    for (unsigned int l = 0; l < lanes; ++l) {
+        if (mem[l] != image) {
+            delete [] mem[l];
+        }
+    }
+}
+
+bool Chip8Lanes::LoadApplication(const unsigned char * data, long size) {
+    if (size < 0 || size > (4096 - 512)) {
+        return false;
+    }
+
+    for (unsigned int l = 0; l < lanes; ++l) {
+        if (mem[l] != image) {
+            delete [] mem[l];
+            mem[l] = image;
+        }
+    }
+    memset(written, 0x00, sizeof(written));
+
+    memset(image, 0x00, sizeof(image));
+    memcpy(image, chip8_fontset, sizeof(chip8_fontset));
+    if (size > 0) {
+        memcpy(image + 512, data, size);
+    }
+    for (int addr = 0; addr < 4096; ++addr) {
+        code[addr] = Chip8Decode((image[addr] << 8) | image[(addr + 1) & 0x0FFF]);
+    }
+    scalarCycles = 0;
+
+    std::fill(V.begin(), V.end(), 0);
+    std::fill(stack.begin(), stack.end(), 0);
+    std::fill(I.begin(), I.end(), 0);
+    std::fill(pc.begin(), pc.end(), 0x200);
+    std::fill(sp.begin(), sp.end(), 0);
+    std::fill(timerDelay.begin(), timerDelay.end(), 0);
+    std::fill(timerSound.begin(), timerSound.end(), 0);
+    std::fill(keys.begin(), keys.end(), 0);
+    std::fill(gfx.begin(), gfx.end(), 0);
+    std::fill(drawFlag.begin(), drawFlag.end(), 1);
+    Seed(seed);
+    cycleCount = 0;
+    return true;
+}
+
+void Chip8Lanes::Seed(uint64_t seed) {
+    this->seed = seed;
+    for (unsigned int l = 0; l < lanes; ++l) {
+        rng[l] = Chip8SeedRandom(seed + l);
+    }
+}
+
+void Chip8Lanes::GetState(unsigned int lane, Chip8State & state) const {
+    memset(&state, 0x00, sizeof(state));
+    memcpy(state.memory, mem[lane], 4096);
+    memcpy(state.gfx[0][0], &gfx[lane * 32], 32 * sizeof(uint64_t));
+    for (int r = 0; r < 16; ++r) {
+        state.stack[r] = stack[r * stride + lane];
+        state.V[r]     = V[r * stride + lane];
+    }
+    state.I           = I[lane];
+    state.pc          = pc[lane];
+    state.sp          = sp[lane];
+    state.timer_delay = timerDelay[lane];
+    state.timer_sound = timerSound[lane];
+    state.drawFlag    = drawFlag[lane];
+    state.planes      = 0x1;
+    state.pitch       = 64;
+    state.rng         = rng[lane];
+    state.cycles      = cycleCount;
+}
+
+void Chip8Lanes::StoreByte(unsigned int lane, unsigned short addr, unsigned char value) {
+    if (mem[lane] == image) {
+        mem[lane] = new unsigned char[4096];
+        memcpy(mem[lane], image, 4096);
+    }
+    mem[lane][addr & 0x0FFF] = value;
+    written[addr & 0x0FFF] = 1;
+}
+
+void Chip8Lanes::TickTimers() {
+    for (unsigned int l = 0; l < lanes; ++l) {
+        timerDelay[l] -= timerDelay[l] > 0;
+        timerSound[l] -= timerSound[l] > 0;
+    }
+}
+
+void Chip8Lanes::RunFrame(unsigned long cycles) {
+    Step(cycles);
+    TickTimers();
+}
+
+// 64 lanes per vector. GCC lowers these to zmm, ymm or xmm operations for
+// the target of each clone. The helpers below are always inlined, so the
+// vector return ABI (-Wpsabi) never comes into play.
+#pragma GCC diagnostic ignored "-Wpsabi"
+#define LANE_INLINE static inline __attribute__((always_inline))
+
+typedef unsigned char  LaneU8  __attribute__((vector_size(64)));
+typedef signed char    LaneS8  __attribute__((vector_size(64)));
+typedef unsigned short LaneU16 __attribute__((vector_size(128)));
+typedef short          LaneS16 __attribute__((vector_size(128)));
+
+template <typename T, typename E> LANE_INLINE T Load(const E * p) {
+    T v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+template <typename T, typename E> LANE_INLINE void Store(E * p, const T & v) {
+    memcpy(p, &v, sizeof(v));
+}
+
+// 0x00 / 0xFF byte masks to 0x0000 / 0xFFFF word masks
+LANE_INLINE LaneU16 Widen(const LaneU8 & m) {
+    return (LaneU16)__builtin_convertvector((LaneS8)m, LaneS16);
+}
+
+LANE_INLINE LaneU8 Narrow(const LaneU16 & m) {
+    return (LaneU8)__builtin_convertvector((LaneS16)m, LaneS8);
+}
+
+template <typename T> LANE_INLINE T Select(const T & m, const T & a, const T & b) {
+    return (a & m) | (b & ~m);
+}
+
+// Compares as 0 / 1 per lane, in plain arithmetic: GCC splits vector
+// compares wider than the target's registers into scalar code
+template <typename T> LANE_INLINE T NotEq(const T & a, const T & b) {
+    T x = a ^ b;
+    return (x | -x) >> (sizeof(x[0]) * 8 - 1);
+}
+
+template <typename T> LANE_INLINE T Less(const T & a, const T & b) {
+    return ((~a & b) | (~(a ^ b) & (a - b))) >> (sizeof(a[0]) * 8 - 1);       // Borrow of a - b
+}
+
+LANE_KERNEL
+void Chip8Lanes::Step(unsigned long cycles) {
+    cycleCount += cycles;
+
+    unsigned short * lpc = &pc[0];
+    unsigned char  * msk = &mask[0];
+    unsigned char  * dn  = &done[0];
+
+    for (unsigned long c = 0; c < cycles; ++c) {
+
+        // Diverged: every lane runs on its own for a while. Keys and timers
+        // don't change inside Step(), so lanes are independent here.
+        if (scalarCycles > 0) {
+            unsigned long n = std::min<unsigned long>(scalarCycles, cycles - c);
+            for (unsigned int l = 0; l < lanes; ++l) {
+                RunLane(l, n);
+            }
+            stats.scalarSteps += (uint64_t)n * lanes;
+            scalarCycles -= n;
+            c += n - 1;
+            continue;
+        }
+
+        memset(dn, 0x00, lanes);            // Padding lanes stay done
+        unsigned int remaining = lanes;
+        unsigned int first     = 0;
+        unsigned int groups    = 0;
+
+        while (remaining > 0) {
+            while (dn[first]) {
+                first++;
+            }
+
+            // Too divergent, finish the cycle lane by lane and stay scalar
+            // for the next SCALAR_BURST cycles
+            if (groups == MAX_GROUPS) {
+                for (unsigned int l = first; l < lanes; ++l) {
+                    if (!dn[l]) {
+                        StepLane(l);
+                    }
+                }
+                stats.scalarSteps += remaining;
+                scalarCycles = SCALAR_BURST;
+                break;
+            }
+
+            // Group = lanes not done yet at the same PC as the first one
+            const unsigned short p = lpc[first];
+            const LaneU16 pv = (LaneU16){} + p;
+            unsigned int count = 0;
+            for (unsigned int b = 0; b < stride; b += 64) {
+                LaneU8 m = Narrow(NotEq(Load<LaneU16>(lpc + b), pv) - 1) & ~Load<LaneU8>(dn + b);
+                Store(msk + b, m);
+                for (int w = 0; w < 8; ++w) {
+                    uint64_t bits;
+                    memcpy(&bits, msk + b + w * 8, 8);
+                    count += __builtin_popcountll(bits) / 8;
+                }
+            }
+
+            // Lanes with their own memory may hold another opcode at p, only
+            // if some lane ever stored there
+            const unsigned char * m0 = mem[first];
+            unsigned short opcode = (m0[p] << 8) | m0[(p + 1) & 0x0FFF];
+            if (written[p] | written[(p + 1) & 0x0FFF]) {
+                for (unsigned int l = first + 1; l < lanes; ++l) {
+                    if (msk[l] && mem[l] != m0 && ((mem[l][p] << 8) | mem[l][(p + 1) & 0x0FFF]) != opcode) {
+                        msk[l] = 0;
+                        count--;
+                    }
+                }
+            }
+
+            if (count == 1) {
+                StepLane(first);
+                stats.scalarSteps++;
+            } else if (StepGroup(opcode)) {
+                stats.vectorSteps += count;
+                stats.groups++;
+            } else {
+                stats.scalarSteps += count;
+            }
+            groups++;
+
+            for (unsigned int b = 0; b < stride; b += 64) {
+                Store(dn + b, Load<LaneU8>(dn + b) | Load<LaneU8>(msk + b));
+            }
+            remaining -= count;
+        }
+
+        // Groups too small to pay for the masking
+        if (groups * MIN_GROUP > lanes) {
+            scalarCycles = SCALAR_BURST;
+        }
+    }
+}
+
+// Every block of 64 lanes with m / m16 = the group mask, statements are
+// selects so lanes outside the group keep their values. VF is written
+// before VX is recomputed from the registers, like the reference, which
+// matters when X or Y is F.
+#define FOR_GROUP(body)                                         \
+    for (unsigned int b = 0; b < stride; b += 64) {             \
+        const LaneU8  m   = Load<LaneU8>(msk + b);              \
+        const LaneU16 m16 = Widen(m);                           \
+        (void)m; (void)m16;                                     \
+        body                                                    \
+    }
+
+#define VX  Load<LaneU8>(vx + b)
+#define VY  Load<LaneU8>(vy + b)
+#define PC  Load<LaneU16>(lpc + b)
+#define IR  Load<LaneU16>(li + b)
+
+LANE_KERNEL
+bool Chip8Lanes::StepGroup(unsigned short opcode) {
+    const Chip8Instr in = Chip8Decode(opcode);
+    const LaneU8  nn  = (LaneU8){} + (unsigned char)(in.nnn & 0x00FF);
+    const LaneU16 nnn = (LaneU16){} + in.nnn;
+    const LaneU8  one = (LaneU8){} + 1;
+    const LaneU16 two = (LaneU16){} + 2;
+    const LaneU16 fff = (LaneU16){} + 0x0FFF;
+
+    const unsigned char * msk = &mask[0];
+    unsigned short * lpc = &pc[0];
+    unsigned short * li  = &I[0];
+    unsigned char  * vx  = &V[in.x * stride];
+    unsigned char  * vy  = &V[in.y * stride];
+    unsigned char  * vf  = &V[0xF * stride];
+
+    switch (in.op) {
+        case OP_JP: {
+            FOR_GROUP( Store(lpc + b, Select(m16, nnn, PC)); )
+            return true;
+        }
+        case OP_JP_V0: {
+            const unsigned char * v0 = &V[0];
+            FOR_GROUP( Store(lpc + b, Select(m16, (nnn + __builtin_convertvector(Load<LaneU8>(v0 + b), LaneU16)) & 0x0FFF, PC)); )
+            return true;
+        }
+        case OP_SE_NN: {
+            FOR_GROUP( Store(lpc + b, PC + ((__builtin_convertvector(NotEq(VX, nn) ^ one, LaneU16) << 1) & m16)); )
+            break;
+        }
+        case OP_SNE_NN: {
+            FOR_GROUP( Store(lpc + b, PC + ((__builtin_convertvector(NotEq(VX, nn), LaneU16) << 1) & m16)); )
+            break;
+        }
+        case OP_SE_VY: {
+            FOR_GROUP( Store(lpc + b, PC + ((__builtin_convertvector(NotEq(VX, VY) ^ one, LaneU16) << 1) & m16)); )
+            break;
+        }
+        case OP_SNE_VY: {
+            FOR_GROUP( Store(lpc + b, PC + ((__builtin_convertvector(NotEq(VX, VY), LaneU16) << 1) & m16)); )
+            break;
+        }
+        case OP_LD_NN: {
+            FOR_GROUP( Store(vx + b, Select(m, nn, VX)); )
+            break;
+        }
+        case OP_ADD_NN: {
+            FOR_GROUP( Store(vx + b, Select(m, (LaneU8)(VX + nn), VX)); )
+            break;
+        }
+        case OP_LD_VY: {
+            FOR_GROUP( Store(vx + b, Select(m, VY, VX)); )
+            break;
+        }
+        case OP_OR: {
+            FOR_GROUP( Store(vx + b, Select(m, VX | VY, VX)); )
+            break;
+        }
+        case OP_AND: {
+            FOR_GROUP( Store(vx + b, Select(m, VX & VY, VX)); )
+            break;
+        }
+        case OP_XOR: {
+            FOR_GROUP( Store(vx + b, Select(m, VX ^ VY, VX)); )
+            break;
+        }
+        case OP_ADD_VY: {
+            FOR_GROUP(
+                Store(vf + b, Select(m, Less((LaneU8)(0xFF - VX), VY), Load<LaneU8>(vf + b)));
+                Store(vx + b, Select(m, (LaneU8)(VX + VY), VX));
+            )
+            break;
+        }
+        case OP_SUB: {
+            FOR_GROUP(
+                Store(vf + b, Select(m, Less(VX, VY) ^ one, Load<LaneU8>(vf + b)));
+                Store(vx + b, Select(m, (LaneU8)(VX - VY), VX));
+            )
+            break;
+        }
+        case OP_SHR: {
+            FOR_GROUP(
+                Store(vf + b, Select(m, VX & one, Load<LaneU8>(vf + b)));
+                Store(vx + b, Select(m, (LaneU8)(VX >> 1), VX));
+            )
+            break;
+        }
+        case OP_SUBN: {
+            FOR_GROUP(
+                Store(vf + b, Select(m, Less(VY, VX) ^ one, Load<LaneU8>(vf + b)));
+                Store(vx + b, Select(m, (LaneU8)(VY - VX), VX));
+            )
+            break;
+        }
+        case OP_SHL: {
+            FOR_GROUP(
+                Store(vf + b, Select(m, (LaneU8)(VX >> 7), Load<LaneU8>(vf + b)));
+                Store(vx + b, Select(m, (LaneU8)(VX << 1), VX));
+            )
+            break;
+        }
+        case OP_LD_I: {
+            FOR_GROUP( Store(li + b, Select(m16, nnn, IR)); )
+            break;
+        }
+        case OP_SKP:
+        case OP_SKNP: {
+            const unsigned short * k = &keys[0];
+            const LaneU16 flip = (in.op == OP_SKP) ? (LaneU16){} : (LaneU16){} + 1;
+            FOR_GROUP(
+                LaneU16 down = (Load<LaneU16>(k + b) >> (__builtin_convertvector(VX, LaneU16) & 0x0F)) & 1;
+                Store(lpc + b, PC + (((down ^ flip) << 1) & m16));
+            )
+            break;
+        }
+        case OP_LD_VX_DT: {
+            const unsigned char * d = &timerDelay[0];
+            FOR_GROUP( Store(vx + b, Select(m, Load<LaneU8>(d + b), VX)); )
+            break;
+        }
+        case OP_LD_DT_VX: {
+            unsigned char * d = &timerDelay[0];
+            FOR_GROUP( Store(d + b, Select(m, VX, Load<LaneU8>(d + b))); )
+            break;
+        }
+        case OP_LD_ST_VX: {
+            unsigned char * s = &timerSound[0];
+            FOR_GROUP( Store(s + b, Select(m, VX, Load<LaneU8>(s + b))); )
+            break;
+        }
+        case OP_ADD_I: {
+            // I + VX > 0xFFF without 16 bit overflow: VX <= 0xFF
+            FOR_GROUP(
+                LaneU16 over = Less(fff, IR) | Less((LaneU16)(fff - __builtin_convertvector(VX, LaneU16)), IR);
+                Store(vf + b, Select(m, Narrow(over), Load<LaneU8>(vf + b)));
+                Store(li + b, Select(m16, IR + __builtin_convertvector(VX, LaneU16), IR));
+            )
+            break;
+        }
+        case OP_LD_F: {
+            FOR_GROUP( Store(li + b, Select(m16, __builtin_convertvector(VX, LaneU16) * 5, IR)); )
+            break;
+        }
+        default: {
+            // Stack, framebuffer, RNG, key wait and memory access
+            for (unsigned int l = 0; l < lanes; ++l) {
+                if (msk[l]) {
+                    Chip8LaneCpu r;
+                    LoadLane(l, r);
+                    ExecLane(l, r, in);
+                    SaveLane(l, r);
+                }
+            }
+            return false;
+        }
+    }
+
+    FOR_GROUP( Store(lpc + b, Select(m16, (PC + two) & 0x0FFF, PC)); )
+    return true;
+}
+
+#undef IR
+#undef PC
+#undef VY
+#undef VX
+#undef FOR_GROUP
+
+// Code nobody stored to comes from the decoded image
+inline Chip8Instr Chip8Lanes::Fetch(unsigned int l, unsigned short p) const {
+    if (written[p] | written[(p + 1) & 0x0FFF]) {
+        return Chip8Decode((mem[l][p] << 8) | mem[l][(p + 1) & 0x0FFF]);
+    }
+    return code[p];
+}
+
+void Chip8Lanes::LoadLane(unsigned int l, Chip8LaneCpu & r) const {
+    for (int i = 0; i < 16; ++i) {
+        r.V[i]     = V[i * stride + l];
+        r.stack[i] = stack[i * stride + l];
+    }
+    r.I     = I[l];
+    r.pc    = pc[l];
+    r.sp    = sp[l];
+    r.delay = timerDelay[l];
+    r.sound = timerSound[l];
+    r.keys  = keys[l];
+    r.rng   = rng[l];
+}
+
+void Chip8Lanes::SaveLane(unsigned int l, const Chip8LaneCpu & r) {
+    for (int i = 0; i < 16; ++i) {
+        V[i * stride + l]     = r.V[i];
+        stack[i * stride + l] = r.stack[i];
+    }
+    I[l]          = r.I;
+    pc[l]         = r.pc;
+    sp[l]         = r.sp;
+    timerDelay[l] = r.delay;
+    timerSound[l] = r.sound;
+    rng[l]        = r.rng;
+}
+
+// One instruction of one lane
+void Chip8Lanes::StepLane(unsigned int l) {
+    RunLane(l, 1);
+}
+
+void Chip8Lanes::RunLane(unsigned int l, unsigned long cycles) {
+    Chip8LaneCpu r;
+    LoadLane(l, r);
+    for (unsigned long c = 0; c < cycles; ++c) {
+        if (!ExecLane(l, r, Fetch(l, r.pc))) {
+            break;          // Waiting for a key, which can't change until Step() returns
+        }
+    }
+    SaveLane(l, r);
+}
+
+// Same as Chip8::EmulateCycle(), returns false if the lane waits in FX0A
+inline __attribute__((always_inline)) bool Chip8Lanes::ExecLane(unsigned int l, Chip8LaneCpu & r, const Chip8Instr & in) {
+    unsigned char * mp = mem[l];
+    unsigned short  p  = r.pc;
+
+    switch (in.op) {
+        case OP_CLS:
+            memset(&gfx[l * 32], 0x00, 32 * sizeof(uint64_t));
+            drawFlag[l] = 1;
+            break;
+        case OP_RET:
+            r.sp = (r.sp - 1) & 0x0F;
+            p = r.stack[r.sp];
+            r.stack[r.sp] = 0x00;
+            break;
+        case OP_JP:         p = in.nnn - OPCODE_LEN;                        break;
+        case OP_CALL:
+            r.stack[r.sp] = p;
+            r.sp = (r.sp + 1) & 0x0F;
+            p = in.nnn - OPCODE_LEN;
+            break;
+        case OP_SE_NN:      if (r.V[in.x] == (in.nnn & 0xFF)) p += 2;       break;
+        case OP_SNE_NN:     if (r.V[in.x] != (in.nnn & 0xFF)) p += 2;       break;
+        case OP_SE_VY:      if (r.V[in.x] == r.V[in.y]) p += 2;             break;
+        case OP_SNE_VY:     if (r.V[in.x] != r.V[in.y]) p += 2;             break;
+        case OP_LD_NN:      r.V[in.x] = in.nnn & 0xFF;                      break;
+        case OP_ADD_NN:     r.V[in.x] += in.nnn & 0xFF;                     break;
+        case OP_LD_VY:      r.V[in.x] = r.V[in.y];                          break;
+        case OP_OR:         r.V[in.x] |= r.V[in.y];                         break;
+        case OP_AND:        r.V[in.x] &= r.V[in.y];                         break;
+        case OP_XOR:        r.V[in.x] ^= r.V[in.y];                         break;
+        case OP_ADD_VY:
+            r.V[0xF] = r.V[in.y] > (0xFF - r.V[in.x]);
+            r.V[in.x] += r.V[in.y];
+            break;
+        case OP_SUB:
+            r.V[0xF] = r.V[in.y] <= r.V[in.x];
+            r.V[in.x] -= r.V[in.y];
+            break;
+        case OP_SHR:
+            r.V[0xF] = r.V[in.x] & 0x01;
+            r.V[in.x] >>= 1;
+            break;
+        case OP_SUBN:
+            r.V[0xF] = r.V[in.y] >= r.V[in.x];
+            r.V[in.x] = r.V[in.y] - r.V[in.x];
+            break;
+        case OP_SHL:
+            r.V[0xF] = r.V[in.x] >> 7;
+            r.V[in.x] <<= 1;
+            break;
+        case OP_LD_I:       r.I = in.nnn;                                   break;
+        case OP_JP_V0:      p = in.nnn + r.V[0] - OPCODE_LEN;               break;
+        case OP_RND:        r.V[in.x] = (Chip8Random(r.rng) % 0xFF) & (in.nnn & 0xFF); break;
+        case OP_DRW:
+            r.V[0xF] = Chip8DrawSprite<Chip8QuirksChip8::wrap>(&gfx[l * 32], mp, r.V[in.x], r.V[in.y], in.n, r.I);
+            drawFlag[l] = 1;
+            break;
+        case OP_SKP:        if ((r.keys >> (r.V[in.x] & 0x0F)) & 1) p += 2;    break;
+        case OP_SKNP:       if (!((r.keys >> (r.V[in.x] & 0x0F)) & 1)) p += 2; break;
+        case OP_LD_VX_DT:   r.V[in.x] = r.delay;                            break;
+        case OP_LD_VX_K: {
+            if (r.keys == 0) {
+                return false;       // Retry next cycle, pc stays
+            }
+            r.V[in.x] = 31 - __builtin_clz(r.keys);   // Highest key down wins, as in the loop of the reference
+            break;
+        }
+        case OP_LD_DT_VX:   r.delay = r.V[in.x];                            break;
+        case OP_LD_ST_VX:   r.sound = r.V[in.x];                            break;
+        case OP_ADD_I:
+            r.V[0xF] = r.I + r.V[in.x] > 0x0FFF;
+            r.I += r.V[in.x];
+            break;
+        case OP_LD_F:       r.I = r.V[in.x] * 0x5;                          break;
+        case OP_LD_B: {
+            unsigned char vx = r.V[in.x];
+            StoreByte(l, r.I,      vx / 100);
+            StoreByte(l, r.I + 1, (vx / 10) % 10);
+            StoreByte(l, r.I + 2, (vx % 100) % 10);
+            mp = mem[l];
+            break;
+        }
+        case OP_LD_MEM_VX: {
+            for (int i = 0; i <= in.x; ++i) {
+                StoreByte(l, r.I + i, r.V[i]);
+            }
+            r.I += in.x + 1;
+            break;
+        }
+        case OP_LD_VX_MEM: {
+            for (int i = 0; i <= in.x; ++i) {
+                r.V[i] = mp[(r.I + i) & 0x0FFF];
+            }
+            r.I += in.x + 1;
+            break;
+        }
+        default:
+            printf("Unknown opcode [0x0000]: 0x%X\n", (mp[p] << 8) | mp[(p + 1) & 0x0FFF]);
+            break;
+    }
+
+    r.pc = (p + OPCODE_LEN) & 0x0FFF;
+    return true;
+}
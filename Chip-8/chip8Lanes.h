@@ -0,0 +1,118 @@
+/*
+ * chip8Lanes.h
+ *  - Lockstep engine for many instances of the same ROM. State is stored
+ *    structure of arrays, one array per register across all lanes, and
+ *    lanes share the ROM image until they first write memory (FX33 / FX55),
+ *    which gives that lane a private copy.
+ *
+ *    Every cycle the lanes are split into groups by PC. A group is executed
+ *    with masked vector operations, 64 lanes at a time (built for AVX-512,
+ *    AVX2 and baseline x86-64, picked at run time). Opcodes that don't
+ *    vectorize (calls, DXYN, RND, FX0A, memory access) are stepped one lane
+ *    at a time. Once a cycle has too many distinct PCs, or groups too small
+ *    to be worth it, the lanes have diverged and each one runs on its own
+ *    for a burst of cycles before lockstep is tried again.
+ *
+ *    Each lane behaves exactly like a Chip8 seeded with seed + lane (same
+ *    RNG and timers, chip8 quirks profile), GetState() returns the same
+ *    bytes.
+ */
+
+#include <stdint.h>
+#include <vector>
+#include "chip8.h"
+
+#ifndef __CHIP8LANES__
+#define __CHIP8LANES__
+
+struct Chip8LaneStats {
+    uint64_t vectorSteps;       // Lane instructions executed by a vector kernel
+    uint64_t scalarSteps;       // Lane instructions executed one by one
+    uint64_t groups;            // Vector kernel executions
+};
+
+// Registers of one lane, gathered for lane by lane execution
+struct Chip8LaneCpu {
+    unsigned char  V[16];
+    unsigned short stack[16];
+    unsigned short I;
+    unsigned short pc;
+    unsigned char  sp;
+    unsigned char  delay;
+    unsigned char  sound;
+    unsigned short keys;
+    uint64_t       rng;
+};
+
+class Chip8Lanes {
+
+    public:
+
+        Chip8Lanes(unsigned int lanes);
+        ~Chip8Lanes();
+
+        bool LoadApplication(const unsigned char * data, long size);   // Resets every lane
+        void Seed(uint64_t seed);                                       // Lane n gets seed + n
+
+        void Step(unsigned long cycles);                    // Every lane runs cycles instructions
+        void TickTimers();                                  // 60 Hz tick, all lanes
+        void RunFrame(unsigned long cycles);
+
+        unsigned int Lanes() const { return lanes; }
+        uint64_t GetCycles() const { return cycleCount; }
+
+        // Per lane I/O
+        void SetKeys(unsigned int lane, unsigned short mask) { keys[lane] = mask; }
+        const uint64_t * Framebuffer(unsigned int lane) const { return &gfx[lane * 32]; }   // 32 rows, bit 63 = leftmost
+        bool GetDrawFlag(unsigned int lane) const { return drawFlag[lane] != 0; }
+        void ClearDrawFlag(unsigned int lane) { drawFlag[lane] = 0; }
+        void GetState(unsigned int lane, Chip8State & state) const;
+
+        const Chip8LaneStats & GetStats() const { return stats; }
+
+    private:
+
+        bool StepGroup(unsigned short opcode);              // Lanes with mask set, false = ran lane by lane
+        // Lane by lane execution on a copy of the lane's registers
+        Chip8Instr Fetch(unsigned int lane, unsigned short addr) const;
+        void LoadLane(unsigned int lane, Chip8LaneCpu & regs) const;
+        void SaveLane(unsigned int lane, const Chip8LaneCpu & regs);
+        void StepLane(unsigned int lane);
+        void RunLane(unsigned int lane, unsigned long cycles);
+        bool ExecLane(unsigned int lane, Chip8LaneCpu & regs, const Chip8Instr & in);
+        void StoreByte(unsigned int lane, unsigned short addr, unsigned char value);
+
+        unsigned int lanes;
+        unsigned int stride;        // lanes rounded up to a multiple of 64
+
+        // SoA registers, index [reg * stride + lane]
+        std::vector<unsigned char>  V;
+        std::vector<unsigned short> stack;
+        std::vector<unsigned short> I;
+        std::vector<unsigned short> pc;
+        std::vector<unsigned char>  sp;
+        std::vector<unsigned char>  timerDelay;
+        std::vector<unsigned char>  timerSound;
+        std::vector<unsigned short> keys;
+        std::vector<uint64_t>       rng;
+
+        // Memory, mem[lane] points at the shared image or a private copy
+        unsigned char               image[4096];
+        std::vector<unsigned char*> mem;
+        unsigned char               written[4096];     // Some lane stored to the address
+        std::vector<Chip8Instr>     code;               // image decoded at every address
+
+        std::vector<uint64_t>       gfx;        // [lane * 32 + row]
+        std::vector<unsigned char>  drawFlag;
+
+        // Group scheduling
+        std::vector<unsigned char>  mask;       // Lane is in the group being executed
+        std::vector<unsigned char>  done;       // Lane already ran this cycle
+        unsigned long               scalarCycles;   // Left in the current lane by lane burst
+
+        uint64_t                    seed;
+        uint64_t                    cycleCount;
+        Chip8LaneStats              stats;
+};
+
+#endif
@@ -0,0 +1,363 @@
+/*
+ * chip8Predecode.cpp
+ *  - Predecoded execution mode. Every PC gets a Chip8Instr entry that is
+ *    decoded on first execution, after that instructions dispatch straight
+ *    from the table with computed goto (one indirect jump per handler).
+ *    StoreByte() resets the entries overlapping any byte written by
+ *    FX33/FX55, so self-modifying ROMs get redecoded.
+ *
+ *    Behaviour matches Chip8::Step() instruction for instruction, one
+ *    instantiation per quirks profile.
+ */
+
+#include "chip8.h"
+
+template <class Q>
+void Chip8::RunPredecoded(unsigned long cycles) {
+
+    static void * const handlers[OP_COUNT] = {
+        &&op_decode,
+        &&op_cls,    &&op_ret,    &&op_jp,     &&op_call,
+        &&op_se_nn,  &&op_sne_nn, &&op_se_vy,  &&op_ld_nn,  &&op_add_nn,
+        &&op_ld_vy,  &&op_or,     &&op_and,    &&op_xor,    &&op_add_vy,
+        &&op_sub,    &&op_shr,    &&op_subn,   &&op_shl,    &&op_sne_vy,
+        &&op_ld_i,   &&op_jp_v0,  &&op_rnd,    &&op_drw,    &&op_skp,
+        &&op_sknp,   &&op_ld_vx_dt, &&op_ld_vx_k, &&op_ld_dt_vx, &&op_ld_st_vx,
+        &&op_add_i,  &&op_ld_f,   &&op_ld_b,   &&op_ld_mem_vx, &&op_ld_vx_mem,
+        &&op_scd,    &&op_scr,    &&op_scl,    &&op_exit,   &&op_low,
+        &&op_high,   &&op_ld_hf,  &&op_ld_r_vx, &&op_ld_vx_r, &&op_scu,
+        &&op_save_vy, &&op_load_vy, &&op_ld_i_long, &&op_plane, &&op_audio,
+        &&op_pitch,
+        &&op_unknown
+    };
+
+    if (cycles == 0) {
+        return;
+    }
+
+    // Work on locals so stores into V[] / memory[] don't force reloads
+    Chip8Instr *   table = &decoded[0];
+    unsigned short lpc   = pc;
+    unsigned short li    = I;
+    unsigned long  left  = cycles;
+    Chip8Instr *   in;
+    const unsigned int mask = Chip8AddrMask<Q>();
+
+// Advance to the next instruction and dispatch
+#define NEXT()                                      \
+    lpc = (lpc + OPCODE_LEN) & 0x0FFF;              \
+    if (--left == 0) {                              \
+        goto done;                                  \
+    }                                               \
+    in = &table[lpc & 0x0FFF];                      \
+    goto *handlers[in->op]
+
+#define SKIP_IF(cond)                               \
+    if (cond) {                                     \
+        lpc += SkipLength<Q>(lpc);                  \
+    }                                               \
+    NEXT()
+
+    in = &table[lpc & 0x0FFF];
+    goto *handlers[in->op];
+
+    op_decode: {
+        unsigned short addr = lpc & 0x0FFF;
+        *in = Chip8Decode((memory[addr] << 8) | memory[(addr + 1) & 0x0FFF], Q::isa);
+        goto *handlers[in->op];
+    }
+    op_cls: {
+        ClearScreen();
+        NEXT();
+    }
+    op_ret: {
+        sp = (sp - 1) & 0x0F;
+        lpc = stack[sp];
+        stack[sp] = 0x00;
+        NEXT();
+    }
+    op_jp: {
+        lpc = in->nnn - OPCODE_LEN;
+        NEXT();
+    }
+    op_call: {
+        stack[sp] = lpc;
+        sp = (sp + 1) & 0x0F;
+        lpc = in->nnn - OPCODE_LEN;
+        NEXT();
+    }
+    op_se_nn: {
+        SKIP_IF(V[in->x] == (in->nnn & 0x00FF));
+    }
+    op_sne_nn: {
+        SKIP_IF(V[in->x] != (in->nnn & 0x00FF));
+    }
+    op_se_vy: {
+        SKIP_IF(V[in->x] == V[in->y]);
+    }
+    op_ld_nn: {
+        V[in->x] = in->nnn & 0x00FF;
+        NEXT();
+    }
+    op_add_nn: {
+        V[in->x] += in->nnn & 0x00FF;
+        NEXT();
+    }
+    op_ld_vy: {
+        V[in->x] = V[in->y];
+        NEXT();
+    }
+    op_or: {
+        V[in->x] |= V[in->y];
+        if (Q::logicVf) {
+            V[0xF] = 0;
+        }
+        NEXT();
+    }
+    op_and: {
+        V[in->x] &= V[in->y];
+        if (Q::logicVf) {
+            V[0xF] = 0;
+        }
+        NEXT();
+    }
+    op_xor: {
+        V[in->x] ^= V[in->y];
+        if (Q::logicVf) {
+            V[0xF] = 0;
+        }
+        NEXT();
+    }
+    // VF is written first and VX/VY re-read afterwards, exactly like the
+    // reference, which matters when X or Y is F.
+    op_add_vy: {
+        V[0xF] = (V[in->y] > (0xFF - V[in->x])) ? 1 : 0;
+        V[in->x] += V[in->y];
+        NEXT();
+    }
+    op_sub: {
+        V[0xF] = (V[in->y] > V[in->x]) ? 0 : 1;
+        V[in->x] -= V[in->y];
+        NEXT();
+    }
+    op_shr: {
+        if (Q::shiftVy) {
+            V[in->x] = V[in->y];
+        }
+        V[0xF] = V[in->x] & 0x01;
+        V[in->x] >>= 1;
+        NEXT();
+    }
+    op_subn: {
+        V[0xF] = (V[in->y] < V[in->x]) ? 0 : 1;
+        V[in->x] = V[in->y] - V[in->x];
+        NEXT();
+    }
+    op_shl: {
+        if (Q::shiftVy) {
+            V[in->x] = V[in->y];
+        }
+        V[0xF] = (V[in->x] & 0x80) >> 7;
+        V[in->x] <<= 1;
+        NEXT();
+    }
+    op_sne_vy: {
+        SKIP_IF(V[in->x] != V[in->y]);
+    }
+    op_ld_i: {
+        li = in->nnn;
+        NEXT();
+    }
+    op_jp_v0: {
+        lpc = in->nnn + V[Q::jumpVx ? in->x : 0] - OPCODE_LEN;
+        NEXT();
+    }
+    op_rnd: {
+        V[in->x] = (Random() % 0xFF) & (in->nnn & 0x00FF);
+        NEXT();
+    }
+    op_drw: {
+        V[0xF] = Draw<Q>(V[in->x], V[in->y], in->n, li);
+        NEXT();
+    }
+    op_skp: {
+        SKIP_IF(key[V[in->x] & 0x0F] != 0);
+    }
+    op_sknp: {
+        SKIP_IF(key[V[in->x] & 0x0F] == 0);
+    }
+    op_ld_vx_dt: {
+        V[in->x] = timer_delay;
+        NEXT();
+    }
+    op_ld_vx_k: {
+        bool keyPress = false;
+        for (int i = 0; i < 16; ++i) {
+            if (key[i] != 0) {
+                V[in->x] = i;
+                keyPress = true;
+            }
+        }
+
+        // No keypress: every remaining cycle retries this opcode without
+        // advancing pc, and key[] can't change until we return.
+        if (!keyPress) {
+            goto done;
+        }
+        NEXT();
+    }
+    op_ld_dt_vx: {
+        timer_delay = V[in->x];
+        NEXT();
+    }
+    op_ld_st_vx: {
+        timer_sound = V[in->x];
+        NEXT();
+    }
+    op_add_i: {
+        if (Q::isa == CHIP8_ISA_XO) {
+            li += V[in->x];
+            NEXT();
+        }
+        V[0xF] = (li + V[in->x] > 0x0FFF) ? 1 : 0;
+        li += V[in->x];
+        NEXT();
+    }
+    op_ld_f: {
+        li = V[in->x] * 0x5;
+        NEXT();
+    }
+    op_ld_b: {
+        // The stores may invalidate *in, which is not used afterwards
+        unsigned char vx = V[in->x];
+        StoreByte( li      & mask,  vx / 100);
+        StoreByte((li + 1) & mask, (vx / 10) % 10);
+        StoreByte((li + 2) & mask, (vx % 100) % 10);
+        NEXT();
+    }
+    op_ld_mem_vx: {
+        int last = in->x;
+        for (int i = 0; i <= last; ++i) {
+            StoreByte((li + i) & mask, V[i]);
+        }
+        if (Q::memIncI) {
+            li += last + 1;
+        }
+        NEXT();
+    }
+    op_ld_vx_mem: {
+        for (int i = 0; i <= in->x; ++i) {
+            V[i] = memory[(li + i) & mask];
+        }
+        if (Q::memIncI) {
+            li += in->x + 1;
+        }
+        NEXT();
+    }
+
+    // SUPER-CHIP / XO-CHIP, only decoded under profiles that have them
+    op_scd: {
+        ScrollDown(in->n);
+        NEXT();
+    }
+    op_scr: {
+        ScrollRight();
+        NEXT();
+    }
+    op_scl: {
+        ScrollLeft();
+        NEXT();
+    }
+    op_exit: {
+        // Stays on 00FD for good, like FX0A without a key
+        goto done;
+    }
+    op_low: {
+        SetHires(false);
+        NEXT();
+    }
+    op_high: {
+        SetHires(true);
+        NEXT();
+    }
+    op_ld_hf: {
+        li = CHIP8_BIGFONT + (V[in->x] & 0x0F) * 10;
+        NEXT();
+    }
+    op_ld_r_vx: {
+        int last = (Q::isa == CHIP8_ISA_SCHIP) ? (in->x & 0x7) : in->x;
+        for (int i = 0; i <= last; ++i) {
+            flags[i] = V[i];
+        }
+        NEXT();
+    }
+    op_ld_vx_r: {
+        int last = (Q::isa == CHIP8_ISA_SCHIP) ? (in->x & 0x7) : in->x;
+        for (int i = 0; i <= last; ++i) {
+            V[i] = flags[i];
+        }
+        NEXT();
+    }
+    op_scu: {
+        ScrollUp(in->n);
+        NEXT();
+    }
+    op_save_vy: {
+        int x = in->x, y = in->y;
+        int step = (x <= y) ? 1 : -1;
+        for (int i = 0, r = x; ; ++i, r += step) {
+            StoreByte((li + i) & mask, V[r]);
+            if (r == y) {
+                break;
+            }
+        }
+        NEXT();
+    }
+    op_load_vy: {
+        int step = (in->x <= in->y) ? 1 : -1;
+        for (int i = 0, r = in->x; ; ++i, r += step) {
+            V[r] = memory[(li + i) & mask];
+            if (r == in->y) {
+                break;
+            }
+        }
+        NEXT();
+    }
+    op_ld_i_long: {
+        // NNNN is read at execution time, it isn't covered by the entry
+        li = (memory[(lpc + 2) & 0x0FFF] << 8) | memory[(lpc + 3) & 0x0FFF];
+        lpc += 2;
+        NEXT();
+    }
+    op_plane: {
+        planes = in->x & 0x3;
+        NEXT();
+    }
+    op_audio: {
+        for (int i = 0; i < 16; ++i) {
+            pattern[i] = memory[(li + i) & mask];
+        }
+        NEXT();
+    }
+    op_pitch: {
+        pitch = V[in->x];
+        NEXT();
+    }
+    op_unknown: {
+        unsigned short addr = lpc & 0x0FFF;
+        printf("Unknown opcode [0x0000]: 0x%X\n", (memory[addr] << 8) | memory[(addr + 1) & 0x0FFF]);
+        NEXT();
+    }
+
+#undef SKIP_IF
+#undef NEXT
+
+    done:
+    pc = lpc;
+    I  = li;
+}
+
+template void Chip8::RunPredecoded<Chip8QuirksChip8>(unsigned long cycles);
+template void Chip8::RunPredecoded<Chip8QuirksVip>(unsigned long cycles);
+template void Chip8::RunPredecoded<Chip8QuirksSchip>(unsigned long cycles);
+template void Chip8::RunPredecoded<Chip8QuirksXo>(unsigned long cycles);
@@ -0,0 +1,178 @@
+/*
+ * chip8Profile.cpp
+ *  - Instrumentation counters and their export, see chip8Profile.h
+ */
+
+#include <algorithm>
+#include "chip8Profile.h"
+
+static const char * const opNames[OP_COUNT] = {
+    "DECODE",
+    "CLS",      "RET",      "JP",       "CALL",
+    "SE_NN",    "SNE_NN",   "SE_VY",    "LD_NN",    "ADD_NN",
+    "LD_VY",    "OR",       "AND",      "XOR",      "ADD_VY",
+    "SUB",      "SHR",      "SUBN",     "SHL",      "SNE_VY",
+    "LD_I",     "JP_V0",    "RND",      "DRW",      "SKP",
+    "SKNP",     "LD_VX_DT", "LD_VX_K",  "LD_DT_VX", "LD_ST_VX",
+    "ADD_I",    "LD_F",     "LD_B",     "LD_MEM_VX", "LD_VX_MEM",
+    "SCD",      "SCR",      "SCL",      "EXIT",     "LOW",
+    "HIGH",     "LD_HF",    "LD_R_VX",  "LD_VX_R",  "SCU",
+    "SAVE_VY",  "LOAD_VY",  "LD_I_LONG", "PLANE",   "AUDIO",
+    "PITCH",
+    "UNKNOWN"
+};
+
+Chip8Profile::Chip8Profile() {
+    Reset();
+}
+
+void Chip8Profile::Reset() {
+    instructions = 0;
+    memset(opCount, 0x00, sizeof(opCount));
+    memset(pcHits, 0x00, sizeof(pcHits));
+    draws  = 0;
+    clears = 0;
+
+    lastDrawn      = 0;
+    lastFrameCycle = 0;
+    frames         = 0;
+    frameCyclesMin = 0;
+    frameCyclesMax = 0;
+    frameCyclesSum = 0;
+    memset(frameBins, 0x00, sizeof(frameBins));
+
+    nodes.clear();
+    children.clear();
+    Node root = { -1, 0, 0 };
+    nodes.push_back(root);
+    current = 0;
+    depth   = 0;
+}
+
+void Chip8Profile::Call(unsigned short addr) {
+    // Past the hardware stack depth the calls are attributed to the caller
+    if (depth >= PROFILE_MAX_DEPTH) {
+        return;
+    }
+    depth++;
+
+    uint64_t key = ((uint64_t)current << 12) | addr;
+    std::unordered_map<uint64_t, int>::const_iterator it = children.find(key);
+    if (it != children.end()) {
+        current = it->second;
+        return;
+    }
+
+    Node node = { current, addr, 0 };
+    nodes.push_back(node);
+    current = (int)nodes.size() - 1;
+    children[key] = current;
+}
+
+void Chip8Profile::Return() {
+    if (depth > 0) {
+        depth--;
+        current = nodes[current].parent;
+    }
+}
+
+void Chip8Profile::Frame(uint64_t cycle) {
+    uint64_t drawn = draws + clears;
+    if (drawn == lastDrawn) {
+        return;
+    }
+    lastDrawn = drawn;
+
+    uint64_t cycles = cycle - lastFrameCycle;
+    lastFrameCycle = cycle;
+
+    frameCyclesMin  = (frames == 0 || cycles < frameCyclesMin) ? cycles : frameCyclesMin;
+    frameCyclesMax  = std::max(frameCyclesMax, cycles);
+    frameCyclesSum += cycles;
+    frames++;
+
+    // Bucket b holds 2^(b-1) < cycles <= 2^b
+    int bin = 0;
+    while (bin < PROFILE_FRAME_BINS - 1 && (1ULL << bin) < cycles) {
+        bin++;
+    }
+    frameBins[bin]++;
+}
+
+std::string Chip8Profile::Path(int node, const std::string & root) const {
+    std::string path;
+    for (; node > 0; node = nodes[node].parent) {
+        char name[16];
+        snprintf(name, sizeof(name), ";sub_%03X", nodes[node].addr);
+        path.insert(0, name);
+    }
+    return root + path;
+}
+
+bool Chip8Profile::WriteFolded(const char * filename, const std::string & root) const {
+    FILE * out = fopen(filename, "w");
+    if (out == NULL) {
+        return false;
+    }
+
+    // One line per call path: "root;sub_2A4;sub_31C count"
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        if (nodes[i].self > 0) {
+            fprintf(out, "%s %llu\n", Path((int)i, root).c_str(), (unsigned long long)nodes[i].self);
+        }
+    }
+    return fclose(out) == 0;
+}
+
+bool Chip8Profile::WriteJson(const char * filename) const {
+    FILE * out = fopen(filename, "w");
+    if (out == NULL) {
+        return false;
+    }
+
+    fprintf(out, "{\n  \"instructions\": %llu,\n  \"draws\": %llu,\n  \"clears\": %llu,\n",
+            (unsigned long long)instructions, (unsigned long long)draws, (unsigned long long)clears);
+
+    fprintf(out, "  \"opcodes\": {");
+    bool first = true;
+    for (int op = OP_CLS; op < OP_COUNT; ++op) {
+        if (opCount[op] > 0) {
+            fprintf(out, "%s\n    \"%s\": %llu", first ? "" : ",", opNames[op], (unsigned long long)opCount[op]);
+            first = false;
+        }
+    }
+    fprintf(out, "\n  },\n");
+
+    fprintf(out, "  \"frames\": {\n    \"count\": %llu,\n    \"cycles_min\": %llu,\n    \"cycles_max\": %llu,\n    \"cycles_mean\": %.1f,\n    \"histogram\": [",
+            (unsigned long long)frames, (unsigned long long)frameCyclesMin, (unsigned long long)frameCyclesMax,
+            frames > 0 ? (double)frameCyclesSum / frames : 0.0);
+    first = true;
+    for (int b = 0; b < PROFILE_FRAME_BINS; ++b) {
+        if (frameBins[b] > 0) {
+            // The last bucket is open ended
+            char bound[24];
+            snprintf(bound, sizeof(bound), b == PROFILE_FRAME_BINS - 1 ? "null" : "%llu", 1ULL << b);
+            fprintf(out, "%s\n      { \"cycles_le\": %s, \"count\": %llu }", first ? "" : ",",
+                    bound, (unsigned long long)frameBins[b]);
+            first = false;
+        }
+    }
+    fprintf(out, "\n    ]\n  },\n");
+
+    // Hottest first
+    std::vector<int> pcs;
+    for (int pc = 0; pc < 4096; ++pc) {
+        if (pcHits[pc] > 0) {
+            pcs.push_back(pc);
+        }
+    }
+    std::stable_sort(pcs.begin(), pcs.end(), [this](int a, int b) { return pcHits[a] > pcHits[b]; });
+
+    fprintf(out, "  \"pc_hits\": [");
+    for (size_t i = 0; i < pcs.size(); ++i) {
+        fprintf(out, "%s\n    { \"pc\": \"%03X\", \"hits\": %llu }", i == 0 ? "" : ",", pcs[i], (unsigned long long)pcHits[pcs[i]]);
+    }
+    fprintf(out, "\n  ]\n}\n");
+
+    return fclose(out) == 0;
+}
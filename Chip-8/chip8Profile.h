@@ -0,0 +1,97 @@
+/*
+ * chip8Profile.h
+ *  - Optional instrumentation of Chip8::EmulateCycle(), built only with
+ *    -DCHIP8_PROFILE. Without it the hooks expand to nothing and Chip8 has
+ *    no extra members, so the normal build is unchanged.
+ *
+ *    Collects per opcode class counts, per PC hit counts, draw / clear
+ *    counts, cycles between frames that drew something, and a call tree
+ *    built from 2NNN / 00EE for flamegraph style folded stacks.
+ *
+ *    While a profile is attached Run() executes on the interpreter in every
+ *    exec mode, so every instruction goes through the hook.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "chip8Decode.h"
+
+#ifndef __CHIP8PROFILE__
+#define __CHIP8PROFILE__
+
+#define PROFILE_MAX_DEPTH   16      // Same as the Chip-8 stack
+#define PROFILE_FRAME_BINS  24      // log2 buckets of cycles per drawn frame
+
+class Chip8Profile {
+
+    public:
+
+        Chip8Profile();
+
+        void Reset();
+
+        // Hooks
+        void Instruction(unsigned short pc, unsigned short opcode, int isa) {
+            Chip8Instr in = Chip8Decode(opcode, isa);
+            opCount[in.op]++;
+            pcHits[pc & 0x0FFF]++;
+            nodes[current].self++;
+            instructions++;
+
+            if (in.op == OP_CALL) {
+                Call(in.nnn);
+            } else if (in.op == OP_RET) {
+                Return();
+            } else if (in.op == OP_DRW) {
+                draws++;
+            } else if (in.op == OP_CLS) {
+                clears++;
+            }
+        }
+        void Frame(uint64_t cycle);     // 60 Hz tick, cycle = cycles executed so far
+
+        // Output
+        bool WriteJson(const char * filename) const;
+        bool WriteFolded(const char * filename, const std::string & root) const;
+
+        uint64_t GetInstructions() const { return instructions; }
+
+    private:
+
+        struct Node {
+            int            parent;
+            unsigned short addr;        // Subroutine entry point
+            uint64_t       self;        // Instructions executed in this call path
+        };
+
+        void Call(unsigned short addr);
+        void Return();
+        std::string Path(int node, const std::string & root) const;
+
+        uint64_t instructions;
+        uint64_t opCount[OP_COUNT];
+        uint64_t pcHits[4096];
+        uint64_t draws;
+        uint64_t clears;
+
+        // Drawn frames
+        uint64_t lastDrawn;             // draws + clears at the last tick
+        uint64_t lastFrameCycle;        // Cycle of the last frame that drew
+        uint64_t frames;
+        uint64_t frameCyclesMin;
+        uint64_t frameCyclesMax;
+        uint64_t frameCyclesSum;
+        uint64_t frameBins[PROFILE_FRAME_BINS];
+
+        // Call tree, node 0 is the top level
+        std::vector<Node>                       nodes;
+        std::unordered_map<uint64_t, int>       children;   // (parent << 12) | addr -> node
+        int                                     current;
+        int                                     depth;
+};
+
+#endif
@@ -0,0 +1,99 @@
+/*
+ * chip8Quirks.h
+ *  - Behaviours Chip-8 interpreters disagree on. A profile is a policy
+ *    class of constexpr flags; the interpreter and the predecoded engine
+ *    are templates on it, so each profile compiles to its own loop with
+ *    the quirk tests folded away. Chip8::SetQuirks() picks the
+ *    specialization at run time, DetectQuirks() (chip8Rom.h) picks a
+ *    profile for a ROM.
+ *
+ *    Code generated or analysed at run time (JIT, wait loop detection)
+ *    reads the same flags from Chip8QuirkFlags.
+ *
+ *    The instruction set is part of the profile: SUPER-CHIP and XO-CHIP
+ *    opcodes only decode under profiles that have them, plain CHIP-8
+ *    profiles keep treating them as unknown (or, for 5XY2 / 5XY3, as 5XY0).
+ */
+
+#ifndef __CHIP8QUIRKS__
+#define __CHIP8QUIRKS__
+
+enum Chip8Isa {
+    CHIP8_ISA_CHIP8,        // 64x32, 4 KB
+    CHIP8_ISA_SCHIP,        // + 128x64 hi-res, scrolling, 16x16 sprites, RPL flags
+    CHIP8_ISA_XO            // + 64 KB memory, second bitplane, F000 NNNN, 5XY2 / 5XY3, 00DN
+};
+
+// What this emulator has always done
+struct Chip8QuirksChip8 {
+    static constexpr bool shiftVy  = false;     // 8XY6/8XYE shift VY into VX (false = VX in place)
+    static constexpr bool memIncI  = true;      // FX55/FX65 leave I at I + X + 1 (false = unchanged)
+    static constexpr bool jumpVx   = false;     // BNNN is BXNN, jumps to XNN + VX (false = NNN + V0)
+    static constexpr bool wrap     = true;      // DXYN wraps sprites at the screen edges (false = clip)
+    static constexpr bool logicVf  = false;     // 8XY1/8XY2/8XY3 reset VF
+    static constexpr int  isa      = CHIP8_ISA_CHIP8;
+};
+
+// Original COSMAC VIP interpreter
+struct Chip8QuirksVip {
+    static constexpr bool shiftVy  = true;
+    static constexpr bool memIncI  = true;
+    static constexpr bool jumpVx   = false;
+    static constexpr bool wrap     = false;
+    static constexpr bool logicVf  = true;
+    static constexpr int  isa      = CHIP8_ISA_CHIP8;
+};
+
+// SUPER-CHIP 1.1 (HP48)
+struct Chip8QuirksSchip {
+    static constexpr bool shiftVy  = false;
+    static constexpr bool memIncI  = false;
+    static constexpr bool jumpVx   = true;
+    static constexpr bool wrap     = false;
+    static constexpr bool logicVf  = false;
+    static constexpr int  isa      = CHIP8_ISA_SCHIP;
+};
+
+// XO-CHIP (Octo)
+struct Chip8QuirksXo {
+    static constexpr bool shiftVy  = true;
+    static constexpr bool memIncI  = true;
+    static constexpr bool jumpVx   = false;
+    static constexpr bool wrap     = true;
+    static constexpr bool logicVf  = false;
+    static constexpr int  isa      = CHIP8_ISA_XO;
+};
+
+// Mask for addresses formed from I: 12 bits, 16 under XO-CHIP
+template <class Q> constexpr unsigned int Chip8AddrMask() {
+    return Q::isa == CHIP8_ISA_XO ? 0xFFFF : 0x0FFF;
+}
+
+enum Chip8Quirks {
+    CHIP8_QUIRKS_CHIP8,
+    CHIP8_QUIRKS_VIP,
+    CHIP8_QUIRKS_SCHIP,
+    CHIP8_QUIRKS_XO,
+    CHIP8_QUIRKS_COUNT
+};
+
+struct Chip8QuirkFlags {
+    bool shiftVy;
+    bool memIncI;
+    bool jumpVx;
+    bool wrap;
+    bool logicVf;
+    int  isa;
+
+    template <class Q> static constexpr Chip8QuirkFlags Of() {
+        return Chip8QuirkFlags{ Q::shiftVy, Q::memIncI, Q::jumpVx, Q::wrap, Q::logicVf, Q::isa };
+    }
+};
+
+const Chip8QuirkFlags & Chip8GetQuirkFlags(Chip8Quirks quirks);
+
+// "chip8", "vip", "schip", "xo"
+const char * Chip8QuirksName(Chip8Quirks quirks);
+bool Chip8QuirksFromName(const char * name, Chip8Quirks & quirks);
+
+#endif
@@ -0,0 +1,118 @@
+/*
+ * chip8Render.cpp
+ */
+
+#include "chip8Render.h"
+#include <GL/glx.h>
+
+// Shade per pixel value, bit n = set in plane n
+static const unsigned char palette[4] = { 0x00, 0xFF, 0x80, 0xC0 };
+
+// Sync buffer swaps to the display refresh, through whichever GLX swap
+// control extension the driver has.
+static void EnableVsync() {
+    typedef void (*SwapIntervalEXT)(Display *, GLXDrawable, int);
+    typedef int  (*SwapInterval)(int);
+
+    SwapIntervalEXT ext = (SwapIntervalEXT)glXGetProcAddress((const GLubyte *)"glXSwapIntervalEXT");
+    if (ext != NULL && glXGetCurrentDisplay() != NULL) {
+        ext(glXGetCurrentDisplay(), glXGetCurrentDrawable(), 1);
+        return;
+    }
+
+    SwapInterval mesa = (SwapInterval)glXGetProcAddress((const GLubyte *)"glXSwapIntervalMESA");
+    if (mesa != NULL) {
+        mesa(1);
+        return;
+    }
+
+    SwapInterval sgi = (SwapInterval)glXGetProcAddress((const GLubyte *)"glXSwapIntervalSGI");
+    if (sgi != NULL) {
+        sgi(1);
+    }
+}
+
+void Chip8Renderer::Init() {
+    memset(shown, 0x00, sizeof(shown));
+    memset(pixels, 0x00, sizeof(pixels));
+    shownHires = false;
+
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, 128, 64, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, pixels);
+
+    EnableVsync();
+}
+
+void Chip8Renderer::UploadRows(int first, int last) {
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, first, 128, last - first + 1, GL_LUMINANCE, GL_UNSIGNED_BYTE, pixels[first]);
+}
+
+void Chip8Renderer::Update(const uint64_t gfx[2][2][64], bool hires) {
+    glBindTexture(GL_TEXTURE_2D, texture);
+
+    // A resolution change redraws everything
+    bool all = (hires != shownHires);
+    shownHires = hires;
+
+    // Runs of changed rows go up in one upload each. Lo-res row y is
+    // texture rows 2y and 2y + 1.
+    const int rows  = hires ? 64 : 32;
+    const int scale = hires ? 1 : 2;
+    int first = -1;
+    for (int y = 0; y < rows; y++) {
+        bool same = !all;
+        for (int p = 0; p < 2 && same; p++) {
+            same = gfx[p][0][y] == shown[p][0][y] && gfx[p][1][y] == shown[p][1][y];
+        }
+        if (same) {
+            if (first >= 0) {
+                UploadRows(first, y * scale - 1);
+                first = -1;
+            }
+            continue;
+        }
+
+        unsigned char * line = pixels[y * scale];
+        for (int x = 0; x < 128 / scale; x++) {
+            int half  = x >> 6;
+            int shift = 63 - (x & 63);
+            unsigned char shade = palette[((gfx[0][half][y] >> shift) & 1) | (((gfx[1][half][y] >> shift) & 1) << 1)];
+            for (int s = 0; s < scale; s++) {
+                line[x * scale + s] = shade;
+            }
+        }
+        if (scale == 2) {
+            memcpy(pixels[y * 2 + 1], line, sizeof(pixels[0]));
+        }
+        for (int p = 0; p < 2; p++) {
+            shown[p][0][y] = gfx[p][0][y];
+            shown[p][1][y] = gfx[p][1][y];
+        }
+        if (first < 0) {
+            first = y * scale;
+        }
+    }
+    if (first >= 0) {
+        UploadRows(first, 63);
+    }
+}
+
+void Chip8Renderer::Draw(int width, int height) {
+    glEnable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glBegin(GL_QUADS);
+        glTexCoord2f(0.0f, 0.0f); glVertex2f(0.0f,         0.0f);
+        glTexCoord2f(0.0f, 1.0f); glVertex2f(0.0f,         (float)height);
+        glTexCoord2f(1.0f, 1.0f); glVertex2f((float)width, (float)height);
+        glTexCoord2f(1.0f, 0.0f); glVertex2f((float)width, 0.0f);
+    glEnd();
+    glDisable(GL_TEXTURE_2D);
+}
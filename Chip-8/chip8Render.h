@@ -0,0 +1,33 @@
+/*
+ * chip8Render.h
+ *  - OpenGL renderer. The framebuffer lives in a single 128x64 texture that
+ *    is drawn as one scaled quad; lo-res frames fill it with 2x2 pixels. Only
+ *    rows that changed since the last present are uploaded again.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <GL/glut.h>
+
+#ifndef __CHIP8RENDER__
+#define __CHIP8RENDER__
+
+class Chip8Renderer {
+
+    public:
+
+        void Init();                            // Needs a current GL context
+        void Update(const uint64_t gfx[2][2][64], bool hires);  // Chip8::gfx, upload the rows that changed
+        void Draw(int width, int height);       // Scaled quad over the window
+
+    private:
+
+        void UploadRows(int first, int last);
+
+        GLuint   texture;
+        uint64_t shown[2][2][64];               // Rows currently in the texture
+        bool     shownHires;
+        unsigned char pixels[64][128];          // Luminance staging buffer
+};
+
+#endif
@@ -0,0 +1,94 @@
+/*
+ * chip8Replay.cpp
+ *  - Headless replay of an input log recorded with chip8Emu -record. Runs
+ *    the session at full speed and prints a hash of the final state, which
+ *    is identical for every exec mode and every run.
+ *
+ *  Build: g++ -O2 chip8.cpp chip8Predecode.cpp chip8Idle.cpp chip8Display.cpp chip8Jit.cpp chip8Scheduler.cpp chip8State.cpp chip8Audio.cpp chip8Input.cpp chip8Rom.cpp chip8Replay.cpp -o chip8-replay
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "chip8.h"
+#include "chip8Input.h"
+#include "chip8Rom.h"
+
+static void Usage() {
+    printf("Usage: chip8-replay [options] rom log\n\n");
+    printf("  -m mode       interpreter | predecoded | jit (default predecoded)\n");
+    printf("  -o file       write the final state (chip8Emu F9 loads it)\n\n");
+}
+
+int main(int argc, char **argv) {
+
+    Chip8ExecMode mode = CHIP8_PREDECODED;
+    const char * stateFile = NULL;
+    std::vector<const char *> files;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            const char * value = argv[++i];
+            if (strcmp(value, "interpreter") == 0) {
+                mode = CHIP8_INTERPRETER;
+            } else if (strcmp(value, "predecoded") == 0) {
+                mode = CHIP8_PREDECODED;
+            } else if (strcmp(value, "jit") == 0) {
+                mode = CHIP8_JIT;
+            } else {
+                Usage();
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            stateFile = argv[++i];
+        } else if (argv[i][0] == '-') {
+            Usage();
+            return 1;
+        } else {
+            files.push_back(argv[i]);
+        }
+    }
+
+    if (files.size() != 2) {
+        Usage();
+        return 1;
+    }
+
+    std::vector<unsigned char> rom;
+    if (!ReadRomFile(files[0], rom)) {
+        fprintf(stderr, "Unable to read %s\n", files[0]);
+        return 1;
+    }
+
+    Chip8InputLog log;
+    if (!log.Load(files[1])) {
+        fprintf(stderr, "Unable to read input log %s\n", files[1]);
+        return 1;
+    }
+
+    Chip8 * c8 = new Chip8();
+    c8->SetExecMode(mode);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if (!log.Replay(*c8, rom.empty() ? NULL : &rom[0], (long)rom.size())) {
+        fprintf(stderr, "%s was not recorded with %s\n", files[1], files[0]);
+        delete c8;
+        return 1;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::vector<unsigned char> state;
+    c8->SaveState(state);
+    printf("%llu cycles, %zu input events in %.3f s (%.1f M cycles/s)\n",
+           (unsigned long long)c8->GetCycles(), log.GetEventCount(), seconds,
+           seconds > 0 ? c8->GetCycles() / seconds / 1e6 : 0.0);
+    printf("state %016llx\n", (unsigned long long)Chip8InputLog::HashRom(&state[0], (long)state.size()));
+
+    if (stateFile != NULL && !c8->SaveState(stateFile)) {
+        fprintf(stderr, "Unable to write %s\n", stateFile);
+    }
+
+    delete c8;
+    return 0;
+}
@@ -0,0 +1,152 @@
+/*
+ * chip8Rewind.cpp
+ *  - Delta format: a list of (skip, length, bytes[length]) records, skip and
+ *    length as LEB128 varints. skip bytes are unchanged (XOR zero), the
+ *    length bytes that follow are XORed into the keyframe.
+ */
+
+#include "chip8Rewind.h"
+
+Chip8Rewind::Chip8Rewind(unsigned int frames, unsigned int keyInterval)
+    : keyInterval(keyInterval > 0 ? keyInterval : 1), seq(0), count(0) {
+    this->frames.resize(frames > 0 ? frames : 1);
+
+    // Room for the keyframe of the oldest frame plus every keyframe after it
+    keys.resize(this->frames.size() / this->keyInterval + 2);
+}
+
+void Chip8Rewind::Clear() {
+    seq   = 0;
+    count = 0;
+}
+
+size_t Chip8Rewind::Bytes() const {
+    size_t bytes = keys.size() * sizeof(Chip8State);
+    for (size_t i = 0; i < frames.size(); ++i) {
+        bytes += frames[i].delta.capacity();
+    }
+    return bytes;
+}
+
+const Chip8State & Chip8Rewind::Key(unsigned long long keySeq) const {
+    return keys[(keySeq / keyInterval) % keys.size()];
+}
+
+static void PutVarint(std::vector<unsigned char> & out, size_t v) {
+    while (v >= 0x80) {
+        out.push_back((v & 0x7F) | 0x80);
+        v >>= 7;
+    }
+    out.push_back(v);
+}
+
+static size_t GetVarint(const unsigned char * & p) {
+    size_t v = 0;
+    int shift = 0;
+    while (*p & 0x80) {
+        v |= (size_t)(*p++ & 0x7F) << shift;
+        shift += 7;
+    }
+    v |= (size_t)*p++ << shift;
+    return v;
+}
+
+void Chip8Rewind::Encode(const unsigned char * a, const unsigned char * b, size_t size, std::vector<unsigned char> & out) {
+    out.clear();
+    size_t i = 0;
+    while (i < size) {
+        // Equal run, skipped a word at a time
+        size_t start = i;
+        while (i + 8 <= size && memcmp(a + i, b + i, 8) == 0) {
+            i += 8;
+        }
+        while (i < size && a[i] == b[i]) {
+            i++;
+        }
+        if (i == size) {
+            break;
+        }
+
+        // Changed run, ends at the first pair of equal bytes (a single equal
+        // byte costs less as a literal than as a new record)
+        size_t lit = i;
+        while (i < size && (a[i] != b[i] || (i + 1 < size && a[i + 1] != b[i + 1]))) {
+            i++;
+        }
+
+        PutVarint(out, lit - start);
+        PutVarint(out, i - lit);
+        for (size_t k = lit; k < i; ++k) {
+            out.push_back(a[k] ^ b[k]);
+        }
+    }
+}
+
+void Chip8Rewind::Decode(const unsigned char * delta, size_t deltaSize, unsigned char * state, size_t size) {
+    const unsigned char * p   = delta;
+    const unsigned char * end = delta + deltaSize;
+    size_t pos = 0;
+    while (p < end) {
+        pos += GetVarint(p);
+        size_t length = GetVarint(p);
+        for (size_t k = 0; k < length && pos < size; ++k) {
+            state[pos++] ^= *p++;
+        }
+    }
+}
+
+void Chip8Rewind::Push(const Chip8 & c8) {
+    Frame & frame = frames[seq % frames.size()];
+    frame.keySeq = seq - (seq % keyInterval);
+
+    if (frame.keySeq == seq) {
+        c8.GetState(keys[(seq / keyInterval) % keys.size()]);
+        frame.delta.clear();
+    } else {
+        c8.GetState(scratch);
+        Encode((const unsigned char *)&scratch, (const unsigned char *)&Key(frame.keySeq), sizeof(Chip8State), frame.delta);
+    }
+
+    seq++;
+    if (count < frames.size()) {
+        count++;
+    }
+}
+
+bool Chip8Rewind::Restore(Chip8State & state, unsigned int back) const {
+    if (back >= count) {
+        return false;
+    }
+
+    const Frame & frame = frames[(seq - 1 - back) % frames.size()];
+    state = Key(frame.keySeq);
+    if (!frame.delta.empty()) {
+        Decode(&frame.delta[0], frame.delta.size(), (unsigned char *)&state, sizeof(Chip8State));
+    }
+    return true;
+}
+
+bool Chip8Rewind::Restore(Chip8 & c8, unsigned int back) const {
+    Chip8State state;
+    if (!Restore(state, back)) {
+        return false;
+    }
+    c8.SetState(state);
+    return true;
+}
+
+void Chip8Rewind::Discard(unsigned int newest) {
+    if (newest > count) {
+        newest = count;
+    }
+    seq   -= newest;
+    count -= newest;
+}
+
+bool Chip8Rewind::StepBack(Chip8 & c8) {
+    if (count < 2) {
+        return false;
+    }
+    Discard(1);
+    return Restore(c8, 0);
+}
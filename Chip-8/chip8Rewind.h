@@ -0,0 +1,55 @@
+/*
+ * chip8Rewind.h
+ *  - In-memory rewind history, one snapshot per frame. Every keyInterval
+ *    frames a full Chip8State is kept, the frames in between are stored as
+ *    the run length encoded XOR against their keyframe. A frame changes few
+ *    bytes, so a delta is typically tens of bytes and minutes of history
+ *    fit in a few MB.
+ *
+ *    Deltas are against the keyframe rather than the previous frame, so any
+ *    frame restores with one keyframe copy plus one delta decode.
+ */
+
+#include <vector>
+#include "chip8.h"
+
+#ifndef __CHIP8REWIND__
+#define __CHIP8REWIND__
+
+class Chip8Rewind {
+
+    public:
+
+        Chip8Rewind(unsigned int frames, unsigned int keyInterval = 60);
+
+        void Push(const Chip8 & c8);                        // Record the current frame
+        bool Restore(Chip8 & c8, unsigned int back) const;  // 0 = newest frame
+        bool Restore(Chip8State & state, unsigned int back) const;
+        void Discard(unsigned int newest);                  // Forget the newest frames
+        bool StepBack(Chip8 & c8);                          // Discard the newest, restore the one before
+        void Clear();
+
+        unsigned int Frames() const { return count; }       // Frames available
+        size_t Bytes() const;                               // Memory held by deltas and keyframes
+
+    private:
+
+        struct Frame {
+            unsigned long long         keySeq;  // Sequence number of its keyframe
+            std::vector<unsigned char> delta;   // Empty for a keyframe
+        };
+
+        const Chip8State & Key(unsigned long long keySeq) const;
+
+        static void Encode(const unsigned char * a, const unsigned char * b, size_t size, std::vector<unsigned char> & out);
+        static void Decode(const unsigned char * delta, size_t deltaSize, unsigned char * state, size_t size);
+
+        unsigned int            keyInterval;
+        std::vector<Frame>      frames;         // Ring, indexed by sequence number
+        std::vector<Chip8State> keys;           // Ring, indexed by sequence / keyInterval
+        unsigned long long      seq;            // Sequence number of the next frame
+        unsigned int            count;
+        Chip8State              scratch;
+};
+
+#endif
@@ -0,0 +1,151 @@
+/*
+ * chip8Rom.cpp
+ */
+
+#include "chip8Rom.h"
+
+#include <algorithm>
+#include <dirent.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
+static bool HasRomExtension(const std::string & name) {
+    size_t dot = name.rfind('.');
+    if (dot == std::string::npos) {
+        return false;
+    }
+    std::string ext = name.substr(dot);
+    return ext == ".ch8" || ext == ".c8" || ext == ".sc8" || ext == ".xo8";
+}
+
+bool ReadRomFile(const std::string & path, std::vector<unsigned char> & data) {
+    FILE * pFile = fopen(path.c_str(), "rb");
+    if (pFile == NULL) {
+        return false;
+    }
+
+    fseek(pFile, 0, SEEK_END);
+    long lSize = ftell(pFile);
+    rewind(pFile);
+
+    data.resize(lSize > 0 ? lSize : 0);
+    size_t result = data.empty() ? 0 : fread(&data[0], 1, data.size(), pFile);
+    fclose(pFile);
+
+    return result == data.size();
+}
+
+bool ListRoms(const std::string & path, std::vector<std::string> & roms) {
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) {
+        return false;
+    }
+
+    if (!S_ISDIR(info.st_mode)) {
+        roms.push_back(path);
+        return true;
+    }
+
+    DIR * dir = opendir(path.c_str());
+    if (dir == NULL) {
+        return false;
+    }
+
+    std::vector<std::string> found;
+    struct dirent * entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (HasRomExtension(entry->d_name)) {
+            found.push_back(path + "/" + entry->d_name);
+        }
+    }
+    closedir(dir);
+
+    std::sort(found.begin(), found.end());
+    roms.insert(roms.end(), found.begin(), found.end());
+    return true;
+}
+
+std::string RomName(const std::string & path) {
+    size_t slash = path.rfind('/');
+    std::string name = (slash == std::string::npos) ? path : path.substr(slash + 1);
+    size_t dot = name.rfind('.');
+    return (dot == std::string::npos) ? name : name.substr(0, dot);
+}
+
+// 00CN, 00FB - 00FF, FX30, FX75, FX85
+static bool IsSchipOpcode(unsigned short opcode) {
+    if ((opcode & 0xFFF0) == 0x00C0) {
+        return (opcode & 0x000F) != 0;
+    }
+    if (opcode >= 0x00FB && opcode <= 0x00FF) {
+        return true;
+    }
+    if ((opcode & 0xF000) == 0xF000) {
+        unsigned short low = opcode & 0x00FF;
+        return low == 0x30 || low == 0x75 || low == 0x85;
+    }
+    return false;
+}
+
+// 00DN, 5XY2, 5XY3, F000, FN01, F002, FX3A
+static bool IsXoOpcode(unsigned short opcode) {
+    if ((opcode & 0xFFF0) == 0x00D0) {
+        return true;
+    }
+    if ((opcode & 0xF00E) == 0x5002) {
+        return true;
+    }
+    if ((opcode & 0xF000) == 0xF000) {
+        unsigned short low = opcode & 0x00FF;
+        return opcode == 0xF000 || opcode == 0xF002 || low == 0x01 || low == 0x3A;
+    }
+    return false;
+}
+
+Chip8Quirks DetectQuirks(const std::vector<unsigned char> & rom) {
+    // Follow the code (jumps, calls, both sides of every skip) instead of
+    // scanning the image, sprite data easily looks like 00FF. Only XO-CHIP
+    // has room for more than 3.5 KB.
+    if (rom.size() > 4096 - 512) {
+        return CHIP8_QUIRKS_XO;
+    }
+    Chip8Quirks found = CHIP8_QUIRKS_CHIP8;
+    std::vector<bool> seen(4096, false);
+    std::vector<unsigned short> work(1, 0x200);
+    while (!work.empty()) {
+        unsigned short addr = work.back();
+        work.pop_back();
+        if (addr < 0x200 || addr > 0x0FFE || (size_t)addr + 2 > 0x200 + rom.size() || seen[addr]) {
+            continue;
+        }
+        seen[addr] = true;
+
+        unsigned short opcode = (rom[addr - 0x200] << 8) | rom[addr - 0x200 + 1];
+        if (IsXoOpcode(opcode)) {
+            return CHIP8_QUIRKS_XO;
+        }
+        if (IsSchipOpcode(opcode)) {
+            found = CHIP8_QUIRKS_SCHIP;
+        }
+        switch (opcode & 0xF000) {
+            case 0x0000:
+                if (opcode == 0x00EE) {
+                    continue;
+                }
+                break;
+            case 0x1000:
+                work.push_back(opcode & 0x0FFF);
+                continue;
+            case 0x2000:
+                work.push_back(opcode & 0x0FFF);
+                break;
+            case 0x3000: case 0x4000: case 0x5000: case 0x9000: case 0xE000:
+                work.push_back(addr + 4);
+                break;
+            case 0xB000:        // Computed target
+                continue;
+        }
+        work.push_back(addr + 2);
+    }
+    return found;
+}
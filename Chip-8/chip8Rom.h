@@ -0,0 +1,29 @@
+/*
+ * chip8Rom.h
+ *  - ROM file helpers shared by the headless drivers.
+ */
+
+#include <string>
+#include <vector>
+#include "chip8Quirks.h"
+
+#ifndef __CHIP8ROM__
+#define __CHIP8ROM__
+
+// Read a whole ROM image into memory
+bool ReadRomFile(const std::string & path, std::vector<unsigned char> & data);
+
+// Expand a ROM path into a sorted list of ROM files. Directories are scanned
+// (non recursively) for .ch8 / .c8 / .sc8 / .xo8 images, plain files are
+// passed through.
+bool ListRoms(const std::string & path, std::vector<std::string> & roms);
+
+// Quirks profile for a ROM image: xo when code reachable from 0x200 uses an
+// XO-CHIP opcode (or the image needs more than 4 KB), schip when it uses
+// one only SUPER-CHIP has, chip8 otherwise
+Chip8Quirks DetectQuirks(const std::vector<unsigned char> & rom);
+
+// File name without directory and extension, e.g. "roms/Chip-8/Pong.ch8" -> "Pong"
+std::string RomName(const std::string & path);
+
+#endif
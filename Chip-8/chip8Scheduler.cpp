@@ -0,0 +1,67 @@
+/*
+ * chip8Scheduler.cpp
+ *  - Frame clock, see chip8Scheduler.h
+ */
+
+#include <errno.h>
+#include "chip8Scheduler.h"
+#include "chip8.h"
+
+#define NSEC_PER_SEC   1000000000L
+#define FRAME_NSEC     (NSEC_PER_SEC / TIMER_HZ)
+#define MAX_LAG_FRAMES 4        // Further behind than this, drop the backlog
+
+static void AddNsec(struct timespec & ts, long ns) {
+    ts.tv_nsec += ns;
+    while (ts.tv_nsec >= NSEC_PER_SEC) {
+        ts.tv_nsec -= NSEC_PER_SEC;
+        ts.tv_sec++;
+    }
+}
+
+static long DiffNsec(const struct timespec & a, const struct timespec & b) {
+    return (a.tv_sec - b.tv_sec) * NSEC_PER_SEC + (a.tv_nsec - b.tv_nsec);
+}
+
+Chip8Scheduler::Chip8Scheduler(unsigned long hz) : hz(hz), carry(0) {
+    StartClock();
+}
+
+void Chip8Scheduler::SetFrequency(unsigned long hz) {
+    this->hz = hz;
+    carry    = 0;
+}
+
+unsigned long Chip8Scheduler::NextFrameCycles() {
+    carry += hz;
+    unsigned long cycles = carry / TIMER_HZ;
+    carry %= TIMER_HZ;
+    return cycles;
+}
+
+void Chip8Scheduler::StartClock() {
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    AddNsec(deadline, FRAME_NSEC);
+}
+
+bool Chip8Scheduler::DeadlineReached() const {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return DiffNsec(now, deadline) >= 0;
+}
+
+void Chip8Scheduler::WaitNextFrame() {
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR) {
+        // Interrupted by a signal, sleep again
+    }
+    AddNsec(deadline, FRAME_NSEC);
+
+    // After a stall (window drag, debugger) start over instead of running
+    // a burst of catch up frames
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (DiffNsec(now, deadline) > MAX_LAG_FRAMES * FRAME_NSEC) {
+        deadline = now;
+        AddNsec(deadline, FRAME_NSEC);
+    }
+}
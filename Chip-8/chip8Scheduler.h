@@ -0,0 +1,43 @@
+/*
+ * chip8Scheduler.h
+ *  - Frame clock. The CPU runs at a configurable rate, independent of the
+ *    60 Hz timers: every frame gets hz / 60 instructions (the remainder is
+ *    carried so the long term rate is exact), then the timers tick once.
+ *    Timers therefore run in emulated time, not per instruction.
+ *
+ *    In real time mode WaitNextFrame() sleeps until the absolute deadline
+ *    of the next frame, so jitter doesn't accumulate.
+ */
+
+#include <time.h>
+
+#ifndef __CHIP8SCHEDULER__
+#define __CHIP8SCHEDULER__
+
+#define CHIP8_DEFAULT_HZ 600
+
+class Chip8Scheduler {
+
+    public:
+
+        Chip8Scheduler(unsigned long hz = CHIP8_DEFAULT_HZ);
+
+        void SetFrequency(unsigned long hz);   // 0 = unlimited
+        unsigned long GetFrequency() const { return hz; }
+        bool Unlimited() const { return hz == 0; }
+
+        unsigned long NextFrameCycles();        // Instructions for the next frame
+
+        // Real time pacing
+        void StartClock();                      // First deadline one frame from now
+        bool DeadlineReached() const;
+        void WaitNextFrame();                   // Sleep until the deadline, then move it on
+
+    private:
+
+        unsigned long   hz;
+        unsigned long   carry;                  // hz % 60 accumulator
+        struct timespec deadline;
+};
+
+#endif
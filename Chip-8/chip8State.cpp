@@ -0,0 +1,216 @@
+/*
+ * chip8State.cpp
+ *  - Machine snapshots. The file format is little endian and independent of
+ *    the host struct layout:
+ *
+ *      "C8ST"              magic
+ *      u16                 version (CHIP8_STATE_VERSION)
+ *      u16 pc, I, sp
+ *      u8  delay, sound, drawFlag
+ *      u8  V[16]
+ *      u16 stack[16]
+ *      u64 gfx[32]              lo-res rows of plane 0
+ *      u8  memory[4096]
+ *      u64 rng, cycles          (version 2)
+ *      u8  hires, planes, pitch (version 3)
+ *      u8  flags[16]
+ *      u8  pattern[16]
+ *      u64 gfx[2][2][64]        gfx[plane][half][row], replaces the rows above
+ *      u8  memory[61440]        0x1000 - 0xFFFF
+ *
+ *    Version 2 states load as lo-res CHIP-8 machines.
+ */
+
+#include "chip8.h"
+
+#define STATE_MAGIC   "C8ST"
+#define STATE_SIZE_V2 (4 + 2 + 6 + 3 + 16 + 32 + 256 + 4096 + 16)
+#define STATE_SIZE    (STATE_SIZE_V2 + 3 + 16 + 16 + CHIP8_PLANES * 2 * 64 * 8 + CHIP8_MEMORY - 4096)
+
+void Chip8::GetState(Chip8State & state) const {
+    memset(&state, 0x00, sizeof(state));    // Padding too, states compare as bytes
+    memcpy(state.memory, memory, sizeof(memory));
+    memcpy(state.gfx, gfx, sizeof(gfx));
+    memcpy(state.stack, stack, sizeof(stack));
+    memcpy(state.V, V, sizeof(V));
+    memcpy(state.flags, flags, sizeof(flags));
+    memcpy(state.pattern, pattern, sizeof(pattern));
+    state.hires       = hires;
+    state.planes      = planes;
+    state.pitch       = pitch;
+    state.I           = I;
+    state.pc          = pc;
+    state.sp          = sp;
+    state.timer_delay = timer_delay;
+    state.timer_sound = timer_sound;
+    state.drawFlag    = drawFlag;
+    state.rng         = rng;
+    state.cycles      = cycleCount;
+}
+
+void Chip8::SetState(const Chip8State & state) {
+    // Only bytes that actually change go through StoreByte(), so restoring a
+    // nearby state keeps most of the decoded / compiled code
+    if (memcmp(memory, state.memory, sizeof(memory)) != 0) {
+        for (int i = 0; i < CHIP8_MEMORY; ++i) {
+            if (memory[i] != state.memory[i]) {
+                StoreByte(i, state.memory[i]);
+            }
+        }
+    }
+    memcpy(gfx, state.gfx, sizeof(gfx));
+    memcpy(stack, state.stack, sizeof(stack));
+    memcpy(V, state.V, sizeof(V));
+    memcpy(flags, state.flags, sizeof(flags));
+    memcpy(pattern, state.pattern, sizeof(pattern));
+    hires       = state.hires != 0;
+    planes      = state.planes & 0x3;
+    pitch       = state.pitch;
+    I           = state.I;
+    pc          = state.pc & 0x0FFF;
+    sp          = state.sp & 0x0F;
+    timer_delay = state.timer_delay;
+    timer_sound = state.timer_sound;
+    drawFlag    = state.drawFlag != 0;
+    rng         = state.rng != 0 ? state.rng : 1;
+    cycleCount  = state.cycles;
+    idleWait    = false;
+}
+
+static unsigned char * Put16(unsigned char * p, unsigned short v) {
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+    return p + 2;
+}
+
+static unsigned short Get16(const unsigned char * p) {
+    return p[0] | (p[1] << 8);
+}
+
+static unsigned char * Put64(unsigned char * p, uint64_t v) {
+    for (int b = 0; b < 64; b += 8) {
+        *p++ = (v >> b) & 0xFF;
+    }
+    return p;
+}
+
+static uint64_t Get64(const unsigned char * p) {
+    uint64_t v = 0;
+    for (int b = 0; b < 64; b += 8) {
+        v |= (uint64_t)*p++ << b;
+    }
+    return v;
+}
+
+void Chip8::SaveState(std::vector<unsigned char> & out) const {
+    out.resize(STATE_SIZE);
+    unsigned char * p = &out[0];
+    memcpy(p, STATE_MAGIC, 4);        p += 4;
+    p = Put16(p, CHIP8_STATE_VERSION);
+    p = Put16(p, pc);
+    p = Put16(p, I);
+    p = Put16(p, sp);
+    *p++ = timer_delay;
+    *p++ = timer_sound;
+    *p++ = drawFlag;
+    memcpy(p, V, 16);                 p += 16;
+    for (int i = 0; i < 16; ++i) {
+        p = Put16(p, stack[i]);
+    }
+    for (int row = 0; row < 32; ++row) {
+        p = Put64(p, gfx[0][0][row]);
+    }
+    memcpy(p, memory, 4096);          p += 4096;
+    p = Put64(p, rng);
+    p = Put64(p, cycleCount);
+    *p++ = hires;
+    *p++ = planes;
+    *p++ = pitch;
+    memcpy(p, flags, 16);             p += 16;
+    memcpy(p, pattern, 16);           p += 16;
+    for (int plane = 0; plane < CHIP8_PLANES; ++plane) {
+        for (int half = 0; half < 2; ++half) {
+            for (int row = 0; row < 64; ++row) {
+                p = Put64(p, gfx[plane][half][row]);
+            }
+        }
+    }
+    memcpy(p, memory + 4096, CHIP8_MEMORY - 4096);
+}
+
+bool Chip8::LoadState(const unsigned char * data, size_t size) {
+    if (size < 6 || memcmp(data, STATE_MAGIC, 4) != 0) {
+        return false;
+    }
+    unsigned short version = Get16(data + 4);
+    if (!(version == CHIP8_STATE_VERSION && size == STATE_SIZE) && !(version == 2 && size == STATE_SIZE_V2)) {
+        return false;
+    }
+
+    Chip8State state;
+    memset(&state, 0x00, sizeof(state));
+    const unsigned char * p = data + 6;
+    state.pc          = Get16(p);     p += 2;
+    state.I           = Get16(p);     p += 2;
+    state.sp          = Get16(p);     p += 2;
+    state.timer_delay = *p++;
+    state.timer_sound = *p++;
+    state.drawFlag    = *p++;
+    memcpy(state.V, p, 16);           p += 16;
+    for (int i = 0; i < 16; ++i) {
+        state.stack[i] = Get16(p);    p += 2;
+    }
+    for (int row = 0; row < 32; ++row) {
+        state.gfx[0][0][row] = Get64(p); p += 8;
+    }
+    memcpy(state.memory, p, 4096);    p += 4096;
+    state.rng         = Get64(p);     p += 8;
+    state.cycles      = Get64(p);     p += 8;
+    state.planes      = 0x1;
+    state.pitch       = 64;
+
+    if (version >= 3) {
+        state.hires   = *p++;
+        state.planes  = *p++;
+        state.pitch   = *p++;
+        memcpy(state.flags, p, 16);   p += 16;
+        memcpy(state.pattern, p, 16); p += 16;
+        for (int plane = 0; plane < CHIP8_PLANES; ++plane) {
+            for (int half = 0; half < 2; ++half) {
+                for (int row = 0; row < 64; ++row) {
+                    state.gfx[plane][half][row] = Get64(p); p += 8;
+                }
+            }
+        }
+        memcpy(state.memory + 4096, p, CHIP8_MEMORY - 4096);
+    }
+
+    SetState(state);
+    return true;
+}
+
+bool Chip8::SaveState(const char * filename) const {
+    std::vector<unsigned char> data;
+    SaveState(data);
+
+    FILE * pFile = fopen(filename, "wb");
+    if (pFile == NULL) {
+        return false;
+    }
+    bool ok = fwrite(&data[0], 1, data.size(), pFile) == data.size();
+    return (fclose(pFile) == 0) && ok;
+}
+
+bool Chip8::LoadState(const char * filename) {
+    FILE * pFile = fopen(filename, "rb");
+    if (pFile == NULL) {
+        return false;
+    }
+
+    // One byte more than a state, so oversized files are rejected too
+    std::vector<unsigned char> data(STATE_SIZE + 1);
+    size_t size = fread(&data[0], 1, data.size(), pFile);
+    fclose(pFile);
+
+    return LoadState(&data[0], size);
+}
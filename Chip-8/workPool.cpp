@@ -0,0 +1,66 @@
+/*
+ * workPool.cpp
+ */
+
+#include "workPool.h"
+
+#include <thread>
+
+WorkPool::WorkPool(unsigned int threads) : queues(threads > 0 ? threads : 1), next(0) {
+}
+
+void WorkPool::Submit(const Job & job) {
+    Queue & q = queues[next];
+    next = (next + 1) % queues.size();
+
+    std::lock_guard<std::mutex> guard(q.lock);
+    q.jobs.push_back(job);
+}
+
+bool WorkPool::Pop(unsigned int self, Job & job) {
+    Queue & q = queues[self];
+    std::lock_guard<std::mutex> guard(q.lock);
+    if (q.jobs.empty()) {
+        return false;
+    }
+    job = q.jobs.back();
+    q.jobs.pop_back();
+    return true;
+}
+
+bool WorkPool::Steal(unsigned int self, Job & job) {
+    for (unsigned int i = 1; i < queues.size(); ++i) {
+        Queue & victim = queues[(self + i) % queues.size()];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (!victim.jobs.empty()) {
+            job = victim.jobs.front();
+            victim.jobs.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkPool::Worker(unsigned int self) {
+    Job job;
+
+    // Jobs are only queued before Run(), so once nothing is left to pop or
+    // steal the pool is drained for good.
+    while (Pop(self, job) || Steal(self, job)) {
+        job();
+    }
+}
+
+void WorkPool::Run() {
+    std::vector<std::thread> workers;
+    for (unsigned int i = 1; i < queues.size(); ++i) {
+        workers.push_back(std::thread(&WorkPool::Worker, this, i));
+    }
+
+    // The calling thread works as worker 0
+    Worker(0);
+
+    for (size_t i = 0; i < workers.size(); ++i) {
+        workers[i].join();
+    }
+}
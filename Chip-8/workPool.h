@@ -0,0 +1,44 @@
+/*
+ * workPool.h
+ *  - Work-stealing thread pool used by the headless drivers. Every worker
+ *    owns a deque: it pops its own jobs from the back and, once that runs
+ *    dry, steals from the front of the other workers' deques.
+ */
+
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#ifndef __WORKPOOL__
+#define __WORKPOOL__
+
+class WorkPool {
+
+    public:
+
+        typedef std::function<void()> Job;
+
+        WorkPool(unsigned int threads);
+
+        unsigned int Threads() const { return (unsigned int)queues.size(); }
+
+        void Submit(const Job & job);   // Queue a job (before Run)
+        void Run();                     // Execute all queued jobs, returns when done
+
+    private:
+
+        struct Queue {
+            std::mutex      lock;
+            std::deque<Job> jobs;
+        };
+
+        bool Pop(unsigned int self, Job & job);
+        bool Steal(unsigned int self, Job & job);
+        void Worker(unsigned int self);
+
+        std::vector<Queue> queues;      // One deque per worker
+        unsigned int       next;        // Round robin submit position
+};
+
+#endif